@@ -0,0 +1,49 @@
+#ifndef __ARC_CURSOR_H__
+#define __ARC_CURSOR_H__
+
+#include "cvputility.h"
+#include "dense_arc_vector.h"
+
+using namespace std;
+
+// Arc-major walk over a multi-commodity flow vector x (or a lazy expression),
+// whose variable a*K+k is the flow of commodity k on arc a. Sorted by index,
+// the flat vector already stores the flows arc by arc, so the nonzeros are
+// read in place; the arc of an entry is tracked from the arc boundaries
+// instead of dividing every index by K, and nothing is copied:
+//
+//   for(ArcCursor<Vector> it(x, K); !it.end(); it.advance())
+//     ... it.arc(), it.commodity(), it.value()
+template <class E>
+class ArcCursor {
+	typename SparseNode<E>::type it;
+	int K, a, base; // current arc and its first variable a*K
+
+	inline void seek(){
+		if(!it.end() && it.index() >= base + K) a = it.index() / K, base = a*K;
+	}
+
+ public:
+	ArcCursor(const SparseExpr<E> &x, int K_) : it(x.derived()), K(K_), a(0), base(0) {
+		seek();
+	}
+
+	inline bool end() const { return it.end(); }
+	inline int arc() const { return a; }
+	inline int commodity() const { return it.index() - base; }
+	inline double value() const { return it.value(); }
+	inline void advance() { it.advance(); seek(); }
+};
+
+// per-arc totals of x (the reduced variable), in one pass over its nonzeros.
+// The solvers carry the totals of their iterates alongside them and update
+// both in lerp() and get_flows(), so this is only needed for vectors that
+// come from elsewhere (QP solves, pruning, initial solutions)
+template <class E>
+DenseArcVector arc_totals(const SparseExpr<E> &x, int A, int K){
+	DenseArcVector y(A);
+	for(ArcCursor<E> it(x, K); !it.end(); it.advance()) y[it.arc()] += it.value();
+	return y;
+}
+
+#endif
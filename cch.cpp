@@ -0,0 +1,392 @@
+#include "cch.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// parts with at most this many vertices are not dissected further
+static const int LEAF_SIZE = 16;
+// vertices per chunk of the parallel customization
+static const int CUSTOMIZE_GRAIN = 32;
+
+// Nested dissection order of the undirected graph (xadj, adj), in verts.
+// A part verts[lo..hi) is searched breadth-first from a pseudo-peripheral
+// vertex and split at the smallest BFS level that leaves at least a
+// quarter of the part on either side: the levels before it and after it
+// are ordered recursively, and the separator level is ranked last.
+// Disconnected parts are split into their components first.
+static void dissect(int V, const vector<int> &xadj, const vector<int> &adj, vector<int> &verts){
+	vector<int> part(V, 0), level(V, -1), queue(V), count;
+	vector< pair<int, int> > stack;
+	int id = 0;
+
+	verts.resize(V);
+	FOR(v, V) verts[v] = v;
+	stack.push_back(make_pair(0, V));
+	while(!stack.empty()){
+		int lo = stack.back().first, hi = stack.back().second, n = hi - lo;
+		stack.pop_back();
+		if(n <= LEAF_SIZE) continue;
+		id++;
+		for(int i = lo; i < hi; i++) part[verts[i]] = id;
+
+		// the second sweep starts from the last vertex of the first
+		int src = verts[lo], nq = 0;
+		FOR(sweep, 2){
+			for(int i = lo; i < hi; i++) level[verts[i]] = -1;
+			queue[0] = src; level[src] = 0; nq = 1;
+			for(int h = 0; h < nq; h++){
+				int v = queue[h];
+				for(int j = xadj[v]; j < xadj[v+1]; j++){
+					int w = adj[j];
+					if(part[w] == id && level[w] < 0) level[w] = level[v] + 1, queue[nq++] = w;
+				}
+			}
+			src = queue[nq-1];
+		}
+
+		if(nq < n){
+			int m = lo;
+			for(int i = lo; i < hi; i++) if(level[verts[i]] >= 0) swap(verts[i], verts[m++]);
+			stack.push_back(make_pair(lo, m));
+			stack.push_back(make_pair(m, hi));
+			continue;
+		}
+
+		int nlev = level[queue[nq-1]] + 1, sep = -1, below = 0;
+		count.assign(nlev, 0);
+		for(int i = lo; i < hi; i++) count[level[verts[i]]]++;
+		FOR(l, nlev){
+			int above = n - below - count[l];
+			if(4*below >= n && 4*above >= n && (sep < 0 || count[l] < count[sep])) sep = l;
+			below += count[l];
+		}
+		if(sep < 0) continue; // no balanced level (a star, say): keep as it is
+
+		int m1 = lo, m2;
+		for(int i = lo; i < hi; i++) if(level[verts[i]] < sep) swap(verts[i], verts[m1++]);
+		m2 = m1;
+		for(int i = m1; i < hi; i++) if(level[verts[i]] > sep) swap(verts[i], verts[m2++]);
+		stack.push_back(make_pair(lo, m1));
+		stack.push_back(make_pair(m1, m2));
+	}
+}
+
+ContractionHierarchy::Workspace::Workspace(int V) :
+	d(V), pe(V), seen(V, 0), done(V, 0), onpath(V, 0), epoch(0) {}
+
+unsigned ContractionHierarchy::Workspace::next_epoch(){
+	if(++epoch == 0){
+		fill(seen.begin(), seen.end(), 0u);
+		fill(done.begin(), done.end(), 0u);
+		epoch = 1;
+	}
+	return epoch;
+}
+
+ContractionHierarchy::ContractionHierarchy(const AdjacentList &adjl) : V(adjl.V) {
+	// undirected adjacency, without loops
+	vector<int> xadj(V+1, 0), adj, pos;
+	FOR(u, V) for(arc_t i = adjl.n_arcs[u]; i < adjl.n_arcs[u+1]; i++){
+		int v = adjl.adjacent_vertices[i];
+		if(v != u) xadj[u+1]++, xadj[v+1]++;
+	}
+	FOR(v, V) xadj[v+1] += xadj[v];
+	adj.resize(xadj[V]);
+	pos.assign(xadj.begin(), xadj.end() - 1);
+	FOR(u, V) for(arc_t i = adjl.n_arcs[u]; i < adjl.n_arcs[u+1]; i++){
+		int v = adjl.adjacent_vertices[i];
+		if(v != u) adj[pos[u]++] = v, adj[pos[v]++] = u;
+	}
+
+	dissect(V, xadj, adj, order);
+	rank.resize(V);
+	FOR(r, V) rank[order[r]] = r;
+	vector<int>().swap(adj);
+
+	// chordal completion: the upper neighbours of r other than the lowest
+	// one p (its parent in the elimination tree) become neighbours of p
+	vector< vector<int> > upper(V);
+	FOR(u, V) for(arc_t i = adjl.n_arcs[u]; i < adjl.n_arcs[u+1]; i++){
+		int x = rank[u], y = rank[adjl.adjacent_vertices[i]];
+		if(x != y) upper[min(x, y)].push_back(max(x, y));
+	}
+	FOR(r, V){
+		vector<int> &N = upper[r];
+		sort(N.begin(), N.end());
+		N.erase(unique(N.begin(), N.end()), N.end());
+		if(N.size() > 1) upper[N[0]].insert(upper[N[0]].end(), N.begin() + 1, N.end());
+	}
+
+	first.assign(V+1, 0);
+	FOR(r, V) first[r+1] = first[r] + upper[r].size();
+	head.resize(first[V]);
+	low.resize(first[V]);
+	FOR(r, V){
+		copy(upper[r].begin(), upper[r].end(), head.begin() + first[r]);
+		fill(low.begin() + first[r], low.begin() + first[r+1], r);
+		vector<int>().swap(upper[r]);
+	}
+	int m = head.size();
+
+	lfirst.assign(V+1, 0);
+	FOR(e, m) lfirst[head[e]+1]++;
+	FOR(r, V) lfirst[r+1] += lfirst[r];
+	ledge.resize(m);
+	pos.assign(lfirst.begin(), lfirst.end() - 1);
+	FOR(e, m) ledge[pos[head[e]]++] = e;
+
+	// level of r: one above the highest level of its lower neighbours
+	vector<int> level(V, 0);
+	int nlev = 0;
+	FOR(r, V){
+		for(int e = first[r]; e < first[r+1]; e++) updatemax(level[head[e]], level[r] + 1);
+		updatemax(nlev, level[r] + 1);
+	}
+	lvfirst.assign(nlev+1, 0);
+	FOR(r, V) lvfirst[level[r]+1]++;
+	FOR(l, nlev) lvfirst[l+1] += lvfirst[l];
+	byLevel.resize(V);
+	pos.assign(lvfirst.begin(), lvfirst.end() - 1);
+	FOR(r, V) byLevel[pos[level[r]]++] = r;
+
+	arcedge.resize(adjl.A);
+	arctail.resize(adjl.A);
+	FOR(u, V) for(arc_t i = adjl.n_arcs[u]; i < adjl.n_arcs[u+1]; i++){
+		int x = rank[u], y = rank[adjl.adjacent_vertices[i]];
+		arctail[i] = u;
+		if(x == y) arcedge[i] = -1;
+		else if(x < y) arcedge[i] = 2*find_edge(x, y);
+		else arcedge[i] = 2*find_edge(y, x) + 1;
+	}
+
+	up.assign(m, COST_INF);
+	down.assign(m, COST_INF);
+	upvia.assign(m, make_pair(-1, -1));
+	downvia.assign(m, make_pair(-1, -1));
+	uplast.assign(m, -1);
+	downlast.assign(m, -1);
+}
+
+// edge {x, y}, x ranked below y
+int ContractionHierarchy::find_edge(int x, int y) const {
+	return lower_bound(head.begin() + first[x], head.begin() + first[x+1], y) - head.begin();
+}
+
+// relaxes the edges of x over its lower triangles x <- z -> y; the edges
+// of every lower neighbour z are final
+void ContractionHierarchy::customize_vertex(int x){
+	for(int j = lfirst[x]; j < lfirst[x+1]; j++){
+		int ezx = ledge[j], z = low[ezx], k = first[x];
+		for(int i = ezx + 1; i < first[z+1]; i++){
+			int y = head[i];
+			while(head[k] != y) k++; // the upper neighbours of z are above x
+			cost_t c = down[ezx] + up[i];
+			if(c < up[k]) up[k] = c, upvia[k] = make_pair(ezx, i), uplast[k] = uplast[i];
+			c = down[i] + up[ezx];
+			if(c < down[k]) down[k] = c, downvia[k] = make_pair(ezx, i), downlast[k] = uplast[ezx];
+		}
+	}
+}
+
+void ContractionHierarchy::customize_chunk(int c, void *job){
+	Job &j = *(Job*) job;
+	int b = c*CUSTOMIZE_GRAIN, e = min(j.n, b + CUSTOMIZE_GRAIN);
+	for(int i = b; i < e; i++) j.cch->customize_vertex(j.ranks[i]);
+}
+
+void ContractionHierarchy::customize(const AdjacentList &adjl){
+	fill(up.begin(), up.end(), COST_INF);
+	fill(down.begin(), down.end(), COST_INF);
+	FOR(i, adjl.A){
+		int h = arcedge[i], e = h >> 1;
+		cost_t c = adjl.costs[i];
+		if(h < 0) continue;
+		if(h & 1){ if(c < down[e]) down[e] = c, downvia[e] = make_pair(-1 - i, -1), downlast[e] = i; }
+		else if(c < up[e]) up[e] = c, upvia[e] = make_pair(-1 - i, -1), uplast[e] = i;
+	}
+
+	FOR(l, lvfirst.size() - 1){
+		Job job = { this, &byLevel[lvfirst[l]], lvfirst[l+1] - lvfirst[l] };
+		if(job.n <= CUSTOMIZE_GRAIN) customize_chunk(0, &job);
+		else ThreadPool::run((job.n + CUSTOMIZE_GRAIN - 1) / CUSTOMIZE_GRAIN, customize_chunk, &job);
+	}
+}
+
+void ContractionHierarchy::query(const AdjacentList &adjl, vertex_t u, const vertex_t *targets, int n,
+                                 Workspace &w, arc_t *pred) const {
+	unsigned epoch = w.next_epoch();
+	int s = rank[u];
+	w.chain.clear();
+	w.sweep.clear();
+
+	// ancestors of the targets, for the downward sweep
+	FOR(i, n)
+		for(int r = rank[targets[i]]; r >= 0 && w.seen[r] != epoch; r = parent(r)){
+			w.seen[r] = epoch;
+			w.d[r] = COST_INF;
+			w.sweep.push_back(r);
+		}
+
+	// upward search over the ancestors of s, in increasing rank
+	for(int r = s; r >= 0; r = parent(r)){
+		if(w.seen[r] != epoch) w.seen[r] = epoch, w.d[r] = COST_INF;
+		w.chain.push_back(r);
+	}
+	w.d[s] = 0;
+	FOR(i, w.chain.size()){
+		int r = w.chain[i];
+		for(int e = first[r]; e < first[r+1]; e++){
+			cost_t c = w.d[r] + up[e];
+			if(c < w.d[head[e]]) w.d[head[e]] = c, w.pe[head[e]] = e;
+		}
+	}
+
+	// downward sweep: the upper neighbours of r are ancestors, done before r
+	sort(w.sweep.begin(), w.sweep.end(), greater<int>());
+	FOR(i, w.sweep.size()){
+		int r = w.sweep[i];
+		for(int e = first[r]; e < first[r+1]; e++){
+			cost_t c = w.d[head[e]] + down[e];
+			if(c < w.d[r]) w.d[r] = c, w.pe[r] = e;
+		}
+	}
+
+	unpack(adjl, u, targets, n, &w.d[0], &w.pe[0], 1, w, pred);
+}
+
+// Writes the predecessor arcs of the paths from u to targets[0..n), given
+// the labels d[r*stride] and the edges pe[r*stride] that gave them. The
+// paths are unpacked from the targets back until they reach u or a vertex
+// of a path already unpacked; half edge h = 2*e + (0 up, 1 down). With
+// zero-cost arcs a path can pass a vertex twice: the later arc into it
+// (nearer to u) replaces the earlier one, which cuts the cycle.
+void ContractionHierarchy::unpack(const AdjacentList &adjl, vertex_t u, const vertex_t *targets, int n,
+                                  const cost_t *d, const int *pe, int stride,
+                                  Workspace &w, arc_t *pred) const {
+	unsigned epoch = w.next_epoch();
+	int s = rank[u];
+	w.done[u] = epoch;
+	FOR(i, n){
+		vertex_t t = targets[i];
+		if(w.done[t] == epoch) continue;
+		int r = rank[t];
+		if(!(d[r*stride] < COST_INF)){
+			w.done[t] = epoch;
+			pred[t] = -1;
+			continue;
+		}
+
+		bool joined = false;
+		while(r != s && !joined){
+			int e = pe[r*stride];
+			if(low[e] == r) w.stack.push_back(2*e + 1), r = head[e];
+			else w.stack.push_back(2*e), r = low[e];
+			while(!w.stack.empty()){
+				int h = w.stack.back();
+				w.stack.pop_back();
+				e = h >> 1;
+				pair<int, int> via = (h & 1) ? downvia[e] : upvia[e];
+				if(via.first >= 0){
+					// x -> z -> y (up) or y -> z -> x (down), last half first
+					if(h & 1) w.stack.push_back(2*via.second + 1), w.stack.push_back(2*via.first);
+					else w.stack.push_back(2*via.first + 1), w.stack.push_back(2*via.second);
+					continue;
+				}
+				arc_t a = -1 - via.first;
+				vertex_t v = adjl.adjacent_vertices[a];
+				if(w.done[v] == epoch && !w.onpath[v]){
+					joined = true;
+					w.stack.clear();
+					break;
+				}
+				if(!w.onpath[v]) w.onpath[v] = 1, w.path.push_back(v);
+				w.done[v] = epoch;
+				pred[v] = a;
+			}
+		}
+		FOR(j, w.path.size()) w.onpath[w.path[j]] = 0;
+		w.path.clear();
+	}
+}
+
+void ContractionHierarchy::sweep(const AdjacentList &adjl, const vertex_t *us, int n,
+                                 const vertex_t *const *targets, const int *ntargets,
+                                 Workspace &w, arc_t *const *preds) const {
+	const int L = LANES;
+	w.D.assign(size_t(V)*L, COST_INF);
+	w.PE.resize(size_t(V)*L);
+	cost_t *D = &w.D[0];
+	int *PE = &w.PE[0];
+
+	// upward search of each origin in its lane
+	FOR(l, n){
+		int s = rank[us[l]];
+		D[s*L + l] = 0;
+		for(int r = s; r >= 0; r = parent(r))
+			for(int e = first[r]; e < first[r+1]; e++){
+				cost_t c = D[r*L + l] + up[e];
+				if(c < D[head[e]*L + l]) D[head[e]*L + l] = c, PE[head[e]*L + l] = e;
+			}
+	}
+
+	// top-down sweep over all ranks, the lanes side by side
+	for(int r = V-1; r >= 0; r--){
+		cost_t *dr = D + r*L;
+		int *pr = PE + r*L;
+		for(int e = first[r]; e < first[r+1]; e++){
+			const cost_t *dw = D + head[e]*L;
+			int l = 0;
+#ifdef __SSE2__
+			__m128 c = _mm_set1_ps(down[e]);
+			__m128i ev = _mm_set1_epi32(e);
+			for(; l+4 <= L; l += 4){
+				__m128 x = _mm_add_ps(_mm_loadu_ps(dw + l), c), y = _mm_loadu_ps(dr + l);
+				__m128i m = _mm_castps_si128(_mm_cmplt_ps(x, y));
+				__m128i p = _mm_loadu_si128((__m128i*) (pr + l));
+				_mm_storeu_ps(dr + l, _mm_min_ps(x, y));
+				_mm_storeu_si128((__m128i*) (pr + l), _mm_or_si128(_mm_and_si128(m, ev), _mm_andnot_si128(m, p)));
+			}
+#endif
+			for(; l < L; l++){
+				cost_t x = dw[l] + down[e];
+				if(x < dr[l]) dr[l] = x, pr[l] = e;
+			}
+		}
+	}
+
+	// every vertex takes the last arc of its path as tree arc; its tail is
+	// on a shortest path too, but with ties on zero-cost arcs the arcs can
+	// close a cycle, and then the paths are unpacked instead
+	FOR(l, n){
+		arc_t *pred = preds[l];
+		FOR(r, V){
+			int e = PE[r*L + l];
+			if(!(D[r*L + l] < COST_INF)) pred[order[r]] = -1;
+			else if(r != rank[us[l]]) pred[order[r]] = low[e] == r ? downlast[e] : uplast[e];
+		}
+		if(!acyclic(us[l], w, pred))
+			unpack(adjl, us[l], targets[l], ntargets[l], D + l, PE + l, L, w, pred);
+	}
+}
+
+// whether the tree arcs pred lead every vertex back to u (or to a vertex
+// without tree arc)
+bool ContractionHierarchy::acyclic(vertex_t u, Workspace &w, const arc_t *pred) const {
+	unsigned epoch = w.next_epoch();
+	bool ok = true;
+	w.done[u] = epoch;
+	for(int v = 0; v < V && ok; v++){
+		int x = v;
+		while(w.done[x] != epoch && !w.onpath[x] && pred[x] >= 0){
+			w.onpath[x] = 1;
+			w.path.push_back(x);
+			x = arctail[pred[x]];
+		}
+		ok = !w.onpath[x];
+		FOR(j, w.path.size()) w.onpath[w.path[j]] = 0, w.done[w.path[j]] = epoch;
+		w.path.clear();
+	}
+	return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef __CCH_H__
+#define __CCH_H__
+
+#include "cvputility.h"
+#include "dijkstra.h"
+
+using namespace std;
+
+// Customizable contraction hierarchy over the arcs of an AdjacentList.
+//
+// The constructor only looks at the topology: it orders the vertices by
+// nested dissection (BFS level separators) and adds the shortcuts of the
+// chordal completion, so that the upper neighbours of every vertex form a
+// clique. Each edge {x, y} of the hierarchy (x ranked below y) carries an
+// up weight (x -> y) and a down weight (y -> x).
+//
+// customize() computes the weights from the current arc costs: the
+// original arcs first, then the lower triangles x <- z -> y of every edge,
+// level by level of the elimination tree, with the vertices of a level
+// spread over the ThreadPool.
+//
+// query() answers one origin and many targets: the upward search of the
+// origin is the chain of its elimination-tree ancestors, and the targets
+// are reached by a downward sweep over the union of their ancestors in
+// decreasing rank. The paths are unpacked into the same predecessor arcs
+// that dijkstra() produces, so the oracle loads them unchanged. When the
+// origins have destinations nearly everywhere, sweep() computes whole
+// trees for several origins in one linear pass instead.
+class ContractionHierarchy {
+ public:
+	// scratch space of one query thread
+	struct Workspace {
+		vector<cost_t> d;         // labels, by rank
+		vector<int> pe;           // edge that gave each label, by rank
+		vector<unsigned> seen;    // by rank: in the chain or in the sweep
+		vector<unsigned> done;    // by vertex: predecessor set in this query
+		vector<char> onpath;      // by vertex: on the path being unpacked
+		unsigned epoch;
+		vector<int> chain, sweep, stack, path;
+		vector<cost_t> D;         // labels of a sweep, LANES per rank
+		vector<int> PE;           // and their edges
+
+		Workspace(int V);
+		unsigned next_epoch();
+	};
+
+	ContractionHierarchy(const AdjacentList &adjl);
+
+	// recomputes the edge weights from adjl.costs (same topology as the
+	// AdjacentList of the constructor)
+	void customize(const AdjacentList &adjl);
+
+	// shortest paths from u to targets[0..n): pred[v] is set to the
+	// adjacency position of the arc into v for the vertices of the paths
+	// (pred[t] = -1 if t is unreachable); other entries are left alone
+	void query(const AdjacentList &adjl, vertex_t u, const vertex_t *targets, int n,
+	           Workspace &w, arc_t *pred) const;
+
+	// full trees of up to LANES origins us[0..n) at once (PHAST): the upward
+	// search of each origin, then one top-down sweep over all ranks that
+	// relaxes the down edges of the origins side by side (SSE2 when
+	// available). The paths to targets[l][0..ntargets[l]) are written to
+	// preds[l] as in query()
+	static const int LANES = 8;
+	void sweep(const AdjacentList &adjl, const vertex_t *us, int n,
+	           const vertex_t *const *targets, const int *ntargets,
+	           Workspace &w, arc_t *const *preds) const;
+
+	int nvertices() const { return V; }
+	int nedges() const { return head.size(); }
+
+ private:
+	int V;
+	vector<int> rank, order;   // rank of each vertex and vertex of each rank
+	vector<int> first, head;   // upward edges of rank r: head[first[r] .. first[r+1]),
+	vector<int> low;           // by increasing rank; low[e] is the lower end
+	vector<int> lfirst, ledge; // edges into r from below: ledge[lfirst[r] .. lfirst[r+1])
+	vector<int> lvfirst, byLevel; // ranks of level l: byLevel[lvfirst[l] .. lvfirst[l+1])
+	vector<int> arcedge;       // 2*edge + (0 up, 1 down) of each arc, -1 for loops
+	vector<cost_t> up, down;
+	// edges (z, x) and (z, y) of the triangle a shortcut goes through, or
+	// (-1-(adjacency position), -1) for an original arc
+	vector< pair<int, int> > upvia, downvia;
+	vector<arc_t> uplast, downlast; // last arc of the path of an edge
+	vector<vertex_t> arctail;      // tail of each arc
+
+	// parent of r in the elimination tree (its lowest upper neighbour)
+	inline int parent(int r) const { return first[r] < first[r+1] ? head[first[r]] : -1; }
+	int find_edge(int x, int y) const;
+	bool acyclic(vertex_t u, Workspace &w, const arc_t *pred) const;
+	void unpack(const AdjacentList &adjl, vertex_t u, const vertex_t *targets, int n,
+	            const cost_t *d, const int *pe, int stride, Workspace &w, arc_t *pred) const;
+	void customize_vertex(int x);
+
+	struct Job {
+		ContractionHierarchy *cch;
+		const int *ranks;
+		int n;
+	};
+	static void customize_chunk(int c, void *job);
+
+	ContractionHierarchy(const ContractionHierarchy &);
+	ContractionHierarchy & operator = (const ContractionHierarchy &);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __COMPACT_SPARSE_VECTOR__
+#define __COMPACT_SPARSE_VECTOR__
+
+// Sparse vector with single precision values (8 bytes per nonzero instead
+// of 12), for keeping large flow iterates in memory. It takes part in the
+// lazy expressions of my_sparse_expr.h: it is updated by assigning an
+// expression to it and read by using it as an operand, e.g.
+//
+//   CompactSparseVector xc(x);              // from a MySparseVector
+//   xc = xc + tau*(sp - xc);                // evaluated in double, stored in float
+//   DenseArcVector y(arc_totals(xc, A, K)); // per-arc totals accumulated in double
+//   Vector x2(xc);                          // back to double precision
+//
+// Only the stored values are rounded; all arithmetic is done in double.
+
+#include "my_sparse_vector.h"
+
+class CompactSparseVector : public SparseExpr<CompactSparseVector> {
+	friend class CompactTerm;
+
+ private:
+	vector<int> idx;   // sorted indices of the nonzeros
+	vector<float> val; // their values
+	int size_;
+
+ public:
+	CompactSparseVector(int n = 0) : idx(), val(), size_(n) {}
+	template <class E> CompactSparseVector(const SparseExpr<E> &e) : idx(), val(), size_(0) {
+		assign(e);
+	}
+	template <class E> CompactSparseVector & operator = (const SparseExpr<E> &e){
+		assign(e);
+		return *this;
+	}
+	template <class E> void assign(const SparseExpr<E> &);
+
+	void swap(CompactSparseVector &x){
+		idx.swap(x.idx);
+		val.swap(x.val);
+		std::swap(size_, x.size_);
+	}
+
+	int size() const { return size_; }
+	int nonZeros() const { return idx.size(); }
+
+	// bytes held by the stored nonzeros, and what the same nonzeros
+	// take in a MySparseVector
+	size_t memory() const { return idx.size()*(sizeof(int) + sizeof(float)); }
+	size_t double_memory() const { return idx.size()*(sizeof(int) + sizeof(double)); }
+};
+
+// Cursor over the nonzeros of a CompactSparseVector (see SparseTerm)
+class CompactTerm : public SparseExpr<CompactTerm> {
+	const int *pi, *pend;
+	const float *pv;
+	int n;
+
+ public:
+	CompactTerm(const CompactSparseVector &v) : n(v.size_) {
+		int nz = v.idx.size();
+		pi = nz ? &v.idx[0] : NULL;
+		pend = pi + nz;
+		pv = nz ? &v.val[0] : NULL;
+	}
+
+	inline bool end() const { return pi == pend; }
+	inline int index() const { return pi == pend ? INT_MAX : *pi; }
+	inline double value() const { return *pv; }
+	inline void step(int i) { if(pi != pend && *pi == i) ++pi, ++pv; }
+	inline void advance() { ++pi; ++pv; }
+	inline int size() const { return n; }
+	inline int capacity() const { return pend - pi; }
+};
+
+template <> struct SparseNode<CompactSparseVector> { typedef CompactTerm type; };
+
+template <class E>
+void CompactSparseVector::assign(const SparseExpr<E> &e_){
+	typename SparseNode<E>::type e(e_.derived());
+	vector<int> ridx;
+	vector<float> rval;
+	ridx.reserve(e.capacity());
+	rval.reserve(e.capacity());
+
+	for(int i = e.index(); i != INT_MAX; e.step(i), i = e.index()){
+		double v = e.value();
+		if(fabs(v) >= 1e-10) ridx.push_back(i), rval.push_back(float(v));
+	}
+
+	// the operands may alias this vector: swap in the result only at the end
+	size_ = e.size();
+	idx.swap(ridx);
+	val.swap(rval);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include <set>
 #include <list>
 #include "dijkstra.h"
+#include "parallel.h"
 
 ILOSTLBEGIN
 
@@ -26,11 +27,14 @@ MatrixXd projection_matrix(const Graph &net){
 	return M;
 }
 
-Vector projection(const MultiCommoNetwork &net, const Vector &x, const MatrixXd &M){
+// x can be a vector or a lazy vector expression (e.g. z-x0),
+// which is then evaluated while filling X
+template <class E>
+Vector projection(const MultiCommoNetwork &net, const SparseExpr<E> &x, const MatrixXd &M){
 	int V = net.getNVertex(), A = net.arcs.size(), K = net.commoflows.size();
   
 	MatrixXd X = MatrixXd::Zero(A,K);
-	ITER(x, itx) X(itx.index()/K, itx.index()%K) = itx.value();
+	for(ArcCursor<E> it(x, K); !it.end(); it.advance()) X(it.arc(), it.commodity()) = it.value();
   
 	MatrixXd P = M*X;
 
@@ -53,10 +57,10 @@ bool check_conservation(const MultiCommoNetwork &net, const Vector &x){
 	double max_deviation = 0.0;
 	FOR(k, K) netflow[k] = vector<double>(V, 0.0);
 
-	ITER(x, itx){
-		int a = itx.index()/K, k = itx.index() % K;
-		netflow[k][net.arcs[a].head] -= itx.value();
-		netflow[k][net.arcs[a].tail] += itx.value();
+	for(ArcCursor<Vector> it(x, K); !it.end(); it.advance()){
+		const NetworkArc &arc = net.arcs[it.arc()];
+		netflow[it.commodity()][arc.head] -= it.value();
+		netflow[it.commodity()][arc.tail] += it.value();
 	}
 
 	FOR(k, K) FOR(v, V)
@@ -136,9 +140,11 @@ IloObjective CVP::linear_proxy_obj(const Vector &x0){
 int mark = true;
 
 bool CVP::is_optimal(const Vector &x, const Vector &z){
-	Vector d(obj->g(x)), y(z);
-	y -= x;
-	return 1+(d.dot(y))/sqrt((y.dot(y))*(d.dot(d))) <= settings.getr("optimality epsilon");
+	Vector d(obj->g(x)), y = z - x;
+	MultiDot md;
+	int dy = md.add(d, y), yy = md.add(y, y), dd = md.add(d, d);
+	md.compute();
+	return 1+md[dy]/sqrt(md[yy]*md[dd]) <= settings.getr("optimality epsilon");
 }
 
 Vector CVP::solve(const IloObjective &iloobj){
@@ -233,7 +239,7 @@ Vector CVP::phase1(Vector *init){
 	do{
 		iteration++;
 		timer->record();    
-		pre_x = x, pre_cost = cur_cost;
+		pre_x.swap(x); pre_cost = cur_cost; // x is overwritten below
 		cur_cost = obj->f(x = solve(linear_proxy_obj(pre_x)));
 		timer->record();
     
@@ -249,6 +255,7 @@ Vector CVP::phase1(Vector *init){
 }
 
 Vector CVP::phase2(Vector *init){
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	Real beta;
 	int count = 0, iteration = 0;
 	Timer *timer = new CPUTimer();
@@ -276,21 +283,22 @@ Vector CVP::phase2(Vector *init){
 	// Loops
 	Vector g, z;
 	while(!exit_flag) {
+		pool.reset(); // iteration boundary
 		if(settings.getb("to reset beta")) 
 			beta = settings.getr("initial beta") * sqrt(x1.dot(x1));
 
 		// Timing and Reporting
 		++iteration; count = 0; timer->record();
 
-		// Previous best solution
-		x0 = x1; f0 = f1;
+		// Previous best solution (x1 is recomputed below)
+		x0.swap(x1); f0 = f1;
     
 		// Reduce beta and do projection until improvement
 		g = obj->g(x0);
 		Real normg = sqrt(g.dot(g)); // added by Hieu
 
 		for(;;) {
-			z = g; z *= (-beta/normg); z += x0; // z = x0 - beta*g
+			z.axpby(1.0, x0, -beta/normg, g); // z = x0 - beta*g
 			x1 = solve(quad_proxy_obj(z));
 			f1 = obj->f(x1);
 			count++; // counting number of solves (for reporting purpose)
@@ -303,7 +311,10 @@ Vector CVP::phase2(Vector *init){
 		// Optimality check
 		g = obj->g(x1); // g is now gradient at x1
 		z -= x1; // z is now z - x1
-		Real cosine = 1 + (z.dot(g))/sqrt((z.dot(z))*(g.dot(g))); //added by Hieu
+		MultiDot md;
+		int zg = md.add(z, g), zz = md.add(z, z), gg = md.add(g, g);
+		md.compute();
+		Real cosine = 1 + md[zg]/sqrt(md[zz]*md[gg]);
 		exit_flag = cosine <= settings.getr("optimality epsilon");
     
 		timer->record();
@@ -316,7 +327,7 @@ Vector CVP::phase2(Vector *init){
 				lambda = section_search(x0, x1, obj, settings.geti("line search iterations"));
 			else 
 				lambda = line_search(x0, x1, obj, settings.geti("line search iterations"));
-			x1 -= x0; x1 *= lambda; x1 += x0; // x1 = x0 + betamin*(x1-x0)
+			x1.lerp(x0, x1, lambda); // x1 = x0 + betamin*(x1-x0)
 			f1 = obj->f(x1);
 		}
 
@@ -333,6 +344,8 @@ Vector CVP::phase2(Vector *init){
 	// Reporting final results
 	tr.print_line(iteration_report);
 	iteration_report<<"Optimal objective: "<<scientific<<setprecision(12)<<obj->f(x1)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	return x1;
 }
@@ -435,6 +448,12 @@ Vector CVP_NF::solvequad(){
 // constructor
 CVP_MCNF::CVP_MCNF(Function *obj_, const MultiCommoNetwork &net_)
 	: CVP(obj_), net(net_) {
+	// vector operations on the flows run in chunks of whole arcs
+	ThreadPool::set_threads(settings.geti("threads"));
+	MySparseVector::set_parallel(settings.geti("parallel threshold"), net.commoflows.size());
+	ShortestPathOracle::set_default_queue(settings.gets("shortest path queue"));
+	ShortestPathOracle::set_default_backend(settings.gets("shortest path backend"));
+	ShortestPathOracle::set_default_direction(settings.gets("shortest path direction"));
 }
 
 Vector CVP_MCNF::optimize(){
@@ -515,6 +534,7 @@ IloObjective CVP_MCNF::initial_proxy_obj(){
 Vector CVP_MCNF::initial_solution(){
 	int K = net.commoflows.size(), A = net.arcs.size();
 	Vector x(variables.getSize());
+	x.enable_position_map(); // commodity-major writes into an arc-major vector
 	FOR(k, K){
 		Network newnet;
 		newnet.arcs = net.arcs;
@@ -540,6 +560,7 @@ Vector CVP_MCNF::solve_by_dijkstra(){
 }
 
 Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	Real beta;
 	int count = 0, iteration = 0;
 	int V = net.getNVertex(), A = net.arcs.size(), K = net.commoflows.size();
@@ -551,10 +572,9 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 
 	// Initialisation by solving the intial network shortest paths
 	ShortestPathOracle DA(net);
-	FOR(a, A){
-		NetworkArc arc = net.arcs[a];
-		DA.set_cost(arc.head, arc.tail, cost_t(arc.cost));
-	}
+	DenseArcVector c0(A);
+	FOR(a, A) c0[a] = net.arcs[a].cost;
+	DA.set_costs(c0);
 	DA.get_flows(x1);
 
 	Real f0, f1 = obj->f(x1); 
@@ -575,9 +595,9 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 	                "lambda*", "tau*0",     "tau*n",
 	                "t_SP", "obj_ls",  "obj_final", "cosine", "t_elapsed");
 
-	Vector g, z, y1, y0;
+	Vector g, z;
 	ReducableFunction *cobj = dynamic_cast<ReducableFunction*>(obj);
-	Function *robj = (cobj)? cobj->reduced_function() : NULL;
+	ReducedFunction *robj = (cobj)? cobj->reduced_function() : NULL;
 
 	MatrixXd M = projection_matrix(net);
 	bool use_analytical_projection = false;
@@ -585,13 +605,14 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 	// Loops
 	Real taubound = -1, taustar = 0.5/5;
 	while(!exit_flag) {
+		pool.reset(); // iteration boundary
 		if(settings.getb("to reset beta")) beta = settings.getr("initial beta") * sqrt(x1.dot(x1));
 
 		// Timing and Reporting
 		++iteration; count = 0; timer->record();
 
-		// Previous best solution
-		x0 = x1; f0 = f1; y0 = y1;
+		// Previous best solution (x1 is recomputed below)
+		x0.swap(x1); f0 = f1;
     
 		// normalized gradient
 		g = obj->g(x0);
@@ -600,7 +621,7 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 		cout<<"Objective before SOCP = "<<f1<<endl;
 
 		for(;;) {
-			z = g; z *= (-beta); z += x0; // z = x0 - beta*g
+			z.axpby(1.0, x0, -beta, g); // z = x0 - beta*g
 
 			// Try analytical solution first
 			x1 = projection(net, z-x0, M) + x0;
@@ -625,7 +646,10 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 		// Optimality check
 		g = obj->g(x1); // g is now gradient at x1
 		z -= x1; // z is now z - x1
-		Real cosine = 1 + (z.dot(g))/sqrt((z.dot(z))*(g.dot(g)));
+		MultiDot md;
+		int zg = md.add(z, g), zz = md.add(z, z), gg = md.add(g, g);
+		md.compute();
+		Real cosine = 1 + md[zg]/sqrt(md[zz]*md[gg]);
 		exit_flag = cosine  <= settings.getr("optimality epsilon"); 
     
 		timer->record(); // for timing
@@ -637,7 +661,7 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 			if(settings.getb("to do golden search")) 
 				lambda = section_search(x0, x1, obj, settings.geti("line search iterations"));
 			else lambda = line_search(x0, x1, obj, settings.geti("line search iterations"));
-			x1 -= x0; x1 *= lambda; x1 += x0; // x1 = x0 + betamin*(x1-x0)
+			x1.lerp(x0, x1, lambda); // x1 = x0 + betamin*(x1-x0)
 			f1 = obj->f(x1);
 		}
     
@@ -648,21 +672,17 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 		// If objective function is reducable, use the reduced function
 		// for more efficient section search
 		if(cobj){
-			Vector y1(cobj->reduced_variable(x1));
+			DenseArcVector y1(cobj->reduced_variable(x1));
 			FOR(iter, settings.geti("SP iterations per SOCP")) {
-				Vector gy(robj->g(y1));
-				DA.reset_cost();
-				ITER(gy, itgy)
-					DA.set_cost(net.arcs[itgy.index()].head,
-					            net.arcs[itgy.index()].tail,
-					            cost_t(itgy.value()));
-				DA.get_flows(sp);
-				Vector ysp(cobj->reduced_variable(sp));
+				DenseArcVector gy(robj->g(y1));
+				DA.set_costs(gy);
+				DenseArcVector ysp(A);
+				DA.get_flows(sp, ysp);
 				timer->record();
 				taustar = section_search(y1, ysp, robj, settings.geti("line search iterations"));
 				timer->record();
-				x1 -= sp;  x1 *= (1-taustar); x1 += sp; 
-				y1 -= ysp; y1 *= (1-taustar); y1 += ysp;
+				x1.lerp(x1, sp, taustar);
+				y1.lerp(y1, ysp, taustar);
 				timer->record();
 				cout<<"Search time = "<<timer->elapsed(-2,-3)<<"; Cal iter "<< settings.geti("SP iterations per SOCP")<<"; Search = "<<timer->elapsed()<<endl;
 				//cout<<"SP time = "<<timer->elapsed(-2,-3)<<"; Search = "<<timer->elapsed()<<endl;
@@ -672,10 +692,12 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 		else 
 			FOR(iter, settings.geti("SP iterations per SOCP")) {
 				g = obj->g(x1);
-				FOR(a, A) DA.set_cost(net.arcs[a].head, net.arcs[a].tail, cost_t(g.coeff(a*K)));
+				DenseArcVector ga(A);
+				FOR(a, A) ga[a] = g.coeff(a*K);
+				DA.set_costs(ga);
 				DA.get_flows(sp);
 				taustar = section_search ( x1, sp, obj, settings.geti("line search iterations"));
-				x1 -= sp; x1 *= (1-taustar); x1 += sp;
+				x1.lerp(x1, sp, taustar);
 				if(iter == 0) taustar0 = taustar; // for reporting
 			}
     
@@ -697,24 +719,31 @@ Vector CVP_MCNF::solve_by_dijkstra_and_SOCP(){
 	// Reporting final results
 	tr.print_line(iteration_report);
 	iteration_report<<"Optimal objective: "<<scientific<<setprecision(12)<<obj->f(x1)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	return x1;
 }
 
 Vector solve_by_dijkstra_only(const MultiCommoNetwork &net, Function *obj, int iterations)
 {
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	int V = net.getNVertex(), A = net.arcs.size(), K = net.commoflows.size();
 	ShortestPathOracle DA(net);
 	Timer *timer = new CPUTimer();
-	Vector x(A*K), sp(A*K);
+	Vector x(A*K), sp(A*K), delta(A*K);
+
+	// dynamic mode: the trees are repaired after each cost update and
+	// sp is updated by the paths that changed
+	bool dynamic = settings.getb("dynamic shortest paths");
+	DA.set_dynamic(dynamic);
 
 	timer->record();
 
 	// Initialisation by solving the intial network shortest paths
-	FOR(a, A) 
-		DA.set_cost(net.arcs[a].head, 
-		            net.arcs[a].tail, 
-		            cost_t(net.arcs[a].cost));
+	DenseArcVector c0(A);
+	FOR(a, A) c0[a] = net.arcs[a].cost;
+	DA.set_costs(c0);
 	DA.get_flows(x);
 
 	// header row of the iteration report
@@ -725,49 +754,47 @@ Vector solve_by_dijkstra_only(const MultiCommoNetwork &net, Function *obj, int i
   
 	// If obj is reducable, a more efficient algorithm is used
 	ReducableFunction *cobj = dynamic_cast<ReducableFunction*>(obj);
-	Function * robj = NULL;
-	Vector y;
+	ReducedFunction * robj = NULL;
+	DenseArcVector y;
 	Real tau;
 	if(cobj) robj = cobj->reduced_function(), y = cobj->reduced_variable(x);
 
 	FOR(iteration, iterations) {
+		pool.reset(); // iteration boundary
 		cout<<"Iteration "<<iteration<<endl;
 		timer->record();
     
 		if(cobj){
-			Vector g(robj->g(y));
-			ITER(g, itg) 
-				DA.set_cost(net.arcs[itg.index()].head, 
-				            net.arcs[itg.index()].tail, 
-				            cost_t(itg.value()));
-			DA.get_flows(sp);
+			DenseArcVector g(robj->g(y));
+			DA.set_costs(g);
+			// the arc totals of sp are loaded from the trees
+			DenseArcVector ysp(A);
+			if(dynamic) DA.get_flow_changes(delta), sp += delta, DA.get_arc_flows(ysp);
+			else DA.get_flows(sp, ysp);
 			timer->record();
 
-			Vector ysp(cobj->reduced_variable(sp));      
 			if(4*tau >= 1.0) tau = section_search(y, ysp, robj);
 			else tau = section_search(y, ysp, robj, 
 			                          settings.geti("line search iterations"), 
 			                          false,
 			                          4*tau*(1-PHI), 4*tau*PHI);
-			//x -= sp;  x *= (1-tau); x += sp;
-			Vector z = (sp - x);
-			x += tau*z;
-			y -= ysp; y *= (1-tau); y += ysp;
+			x.lerp(x, sp, tau);
+			y.lerp(y, ysp, tau);
 		}
 		else{
 			Vector g(obj->g(x));
-			FOR(a, A) 
-				DA.set_cost(net.arcs[a].head, 
-				            net.arcs[a].tail, 
-				            cost_t(g.coeff(a*K)));
-			DA.get_flows(sp);
+			DenseArcVector ga(A);
+			FOR(a, A) ga[a] = g.coeff(a*K);
+			DA.set_costs(ga);
+			if(dynamic) DA.get_flow_changes(delta), sp += delta;
+			else DA.get_flows(sp);
 			timer->record();
       
 			if(4*tau >= 1.0) tau = section_search(x, sp, obj);
 			else tau = section_search(x, sp, obj, 
 			                          settings.geti("line search iterations"), 
 			                          false, 4*tau*(1-PHI), 4*tau*PHI);
-			x -= sp; x *= (1-tau); x += sp;
+			x.lerp(x, sp, tau);
 		}
 
 		timer->record();
@@ -785,6 +812,8 @@ Vector solve_by_dijkstra_only(const MultiCommoNetwork &net, Function *obj, int i
 	tr.print_line(iteration_report);
 	iteration_report<<"Optimal objective: "
 	                <<scientific<<setprecision(12)<<obj->f(x)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	return x;  
 }
@@ -845,13 +874,14 @@ void CVP_MCNF_KL::generate_network_constraints(){
 
 
 Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	int count = 0, iteration = 0;
 	int V = net.getNVertex(), A = net.arcs.size(), K = net.commoflows.size();
 	Timer *timer = new CPUTimer;
 	bool exit_flag = false;
 	KleinrockFunction *kl = dynamic_cast<KleinrockFunction*>(obj); 
 	assert(kl!=NULL);
-	Function *rkl = kl->reduced_function();
+	ReducedFunction *rkl = kl->reduced_function();
 
 	timer->record();
 	ShortestPathOracle DA(net);
@@ -879,10 +909,12 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 	                "ls?",  "lambda*", "tau*0",     "tau*n",
 	                "t_SP", "obj_ls",  "obj_final", "cosine", "t_elapsed");
 
-	// Loops
+	// Loops (y0, y1 are the arc totals of x0, x1)
 	Vector g, z;
+	DenseArcVector y0(A), y1(kl->reduced_variable(x1));
 	Real taubound = -1, taustar = 0.5/5;
 	while(!exit_flag) {
+		pool.reset(); // iteration boundary
 		// Timing and Reporting
 		iteration ++; count = 0; timer->record();
 		cout<<"Mark 0"<<endl;
@@ -890,8 +922,8 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 		if(settings.getb("to reset beta")) 
 			beta = settings.getr("initial beta") * sqrt(x1.dot(x1));
 
-		// Previous best solution
-		x0 = x1; f0 = f1;
+		// Previous best solution (x1 is recomputed below)
+		x0.swap(x1); f0 = f1; y0.swap(y1);
     
 		// normalized gradient
 		g = obj->g(x0);
@@ -899,13 +931,13 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 
 		// reduce beta and do projection until feasibility and improvement
 		for(;;) {
-			z = g; z *= (-beta); z += x0; // z = x0 - beta*g
+			z.axpby(1.0, x0, -beta, g); // z = x0 - beta*g
 			x1 = solve(quad_proxy_obj(z));
 			count++; // counting number of solves (for reporting)
 
 			bool feasible = true;
-			Vector y1(kl->reduced_variable(x1));
-			ITER(y1, ity1) if (ity1.value() >= net.arcs[ity1.index()].cap){
+			y1 = kl->reduced_variable(x1);
+			FOR(a, A) if (y1[a] >= net.arcs[a].cap){
 				feasible = false;
 				break;
 			}
@@ -920,7 +952,10 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 		// Optimality check
 		g = obj->g(x1); // g is now gradient at x1
 		z -= x1;        // z is now z - x1
-		Real cosine = 1 + (z.dot(g))/sqrt((z.dot(z))*(g.dot(g)));
+		MultiDot md;
+		int zg = md.add(z, g), zz = md.add(z, z), gg = md.add(g, g);
+		md.compute();
+		Real cosine = 1 + md[zg]/sqrt(md[zz]*md[gg]);
 		exit_flag = cosine  <= settings.getr("optimality epsilon"); 
     
 		timer->record(); // for timing
@@ -932,38 +967,34 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 			if(settings.getb("to do golden search")) 
 				lambda = section_search(x0, x1, obj, settings.geti("line search iterations"));
 			else lambda = line_search(x0, x1, obj, settings.geti("line search iterations"));
-			x1 -= x0; x1 *= lambda; x1 += x0; // x1 = x0 + betamin*(x1-x0)
-			f1 = obj->f(x1);
+			x1.lerp(x0, x1, lambda); // x1 = x0 + betamin*(x1-x0)
+			y1.lerp(y0, y1, lambda);
+			f1 = rkl->f(y1);
 		}
     
 		timer->record(); // for timing
     
 		Real f_ls = f1, fsp, taustar0 = 0.0; // for reporting
-		Vector y1(kl->reduced_variable(x1));
 		FOR(iter, settings.geti("SP iterations per SOCP")) {
-			Vector gy(rkl->g(y1));
-			ITER(gy, itgy)
-				DA.set_cost(net.arcs[itgy.index()].head, 
-				            net.arcs[itgy.index()].tail, 
-				            cost_t(itgy.value()));
-			DA.get_flows(sp);
-			Vector ysp(kl->reduced_variable(sp));
+			DenseArcVector gy(rkl->g(y1));
+			DA.set_costs(gy);
+			DenseArcVector ysp(A);
+			DA.get_flows(sp, ysp);
 
 			// feasibility search
 			Real alpha = 1.0;
-			ITER(ysp, itysp){
-				int a = itysp.index();
-				Real yspa = itysp.value(), y1a = y1.coeff(a);
+			FOR(a, A){
+				Real yspa = ysp[a], y1a = y1[a];
 				if(yspa > y1a) 
 					updatemin(alpha, (net.arcs[a].cap*0.9999 - y1a)/(yspa-y1a));
 			}
 			assert(alpha>0.0); // Hopefully we can find a new feasible solution
-			sp  -= x1; sp  *= alpha; sp  += x1;
-			ysp -= y1; ysp *= alpha; ysp += y1;
+			sp.lerp(x1, sp, alpha);
+			ysp.lerp(y1, ysp, alpha);
       
 			taustar = section_search ( y1, ysp, rkl, settings.geti("line search iterations"));
-			x1 -= sp;  x1 *= (1-taustar); x1 += sp; 
-			y1 -= ysp; y1 *= (1-taustar); y1 += ysp; 
+			x1.lerp(x1, sp, taustar);
+			y1.lerp(y1, ysp, taustar);
 			f1 = rkl->f(y1);
 
 			if(iter == 0) taustar0 = taustar; // for reporting
@@ -983,6 +1014,8 @@ Vector CVP_MCNF_KL::solve_by_dijkstra_and_SOCP(){
 	// Reporting final results
 	tr.print_line(iteration_report);
 	iteration_report<<"Optimal objective: "<<scientific<<setprecision(12)<<obj->f(x1)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	return x1;
 }
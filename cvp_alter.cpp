@@ -1,6 +1,8 @@
 #include "network.h"
 #include "function.h"
 #include "solver.h"
+#include "compact_sparse_vector.h"
+#include "parallel.h"
 #include <list>
 #include <ilcplex/cplex.h>
 
@@ -57,10 +59,10 @@ bool check_conservation(const MultiCommoNetwork &net,Vector &x){
 	double max_deviation = 0.0;
 	FOR(k, K) netflow[k] = vector<double>(V, 0.0);
 	
-	ITER(x, itx){
-		int a = itx.index()/K, k = itx.index() % K;
-		netflow[k][net.arcs[a].head] -= itx.value();
-		netflow[k][net.arcs[a].tail] += itx.value();
+	for(ArcCursor<Vector> it(x, K); !it.end(); it.advance()){
+		const NetworkArc &arc = net.arcs[it.arc()];
+		netflow[it.commodity()][arc.head] -= it.value();
+		netflow[it.commodity()][arc.tail] += it.value();
 	}
 	
 	FOR(k, K) FOR(v, V)
@@ -84,9 +86,8 @@ bool check_conservation(const MultiCommoNetwork &net,Vector &x){
 }
 
 bool check_capacity(const MultiCommoNetwork &net, Vector &x){
-	vector<double> flows(A, 0.0);
-	ITER(x, itx) flows[itx.index()/K] += itx.value();
-	FOR(a,A) if(flows[a] > net.arcs[a].cap){
+	DenseArcVector y(arc_totals(x, A, K));
+	FOR(a,A) if(y[a] > net.arcs[a].cap){
 		cout<<"Violate of cap constraint at arc "<<a<<endl;
 		return false;
 	}
@@ -128,6 +129,13 @@ void init(const MultiCommoNetwork &net){
 		matval[2*a]   = -1.0,
 	  matval[2*a+1] = 1.0;
 
+	// vector operations on the flows run in chunks of whole arcs
+	ThreadPool::set_threads(settings.geti("threads"));
+	MySparseVector::set_parallel(settings.geti("parallel threshold"), K);
+	ShortestPathOracle::set_default_queue(settings.gets("shortest path queue"));
+	ShortestPathOracle::set_default_backend(settings.gets("shortest path backend"));
+	ShortestPathOracle::set_default_direction(settings.gets("shortest path direction"));
+
 	if(settings.gets("Solver")=="cplex")
 		solver = new CPXSolver();
 	else
@@ -177,20 +185,18 @@ void release(){
 }
 
 
-void socp(const MultiCommoNetwork &net, Vector &x0, Vector &g, Real beta, Vector &p_){
-	p_ = Vector(A*K);
-	bool use_tmp = settings.geti("memory parsimony level")>=1;
+void socp(const MultiCommoNetwork &net, Vector &x0, const DenseArcVector &g, Real beta, Vector &p_){
+	SparseBuilder builder(A*K);
+	builder.reserve(x0.nonZeros());
 
 	typedef pair<int, Real> PAIRIR;
 	typedef list<PAIRIR> LPAIRIR;
 	int *collist = (int*) malloc(A*sizeof(int));
 	vector<LPAIRIR> x(K);
-	vector<LPAIRIR> *tmp = use_tmp? new vector<LPAIRIR>(A) : NULL;
 	double rhsval[2];
 	int rhsind[2];
 
-	FOR(a, A) z[a] = 0.0;
-	ITER(g, itg) z[itg.index()] = 2*beta*itg.value();
+	FOR(a, A) z[a] = 2*beta*g[a];
 
 	ITER(x0, itx0)
 		x[itx0.index()%K].push_back(make_pair(itx0.index()/K, itx0.value()));
@@ -219,21 +225,9 @@ void socp(const MultiCommoNetwork &net, Vector &x0, Vector &g, Real beta, Vector
 			z[(*it).first] += 2*(*it).second;
 		x[k].clear();
 
-		if(use_tmp) 
-			FOR(a, A) 
-				if(p[a] > 1e-10) (*tmp)[a].push_back(make_pair(k, p[a])); 
-				else;
-		else 
-			FOR(a,A) 
-				p_.insert(a*K+k) = p[a];
-	}
-	
-	if(use_tmp){
-		FOR(a, A)
-			for(LPAIRIR::iterator it = (*tmp)[a].begin(); it != (*tmp)[a].end(); ++it)
-				p_.insert(a*K+(*it).first) = (*it).second;
-		delete tmp;
+		FOR(a, A) if(p[a] > 1e-10) builder.add(a*K+k, p[a]);
 	}
+	builder.finalize(p_);
 
 	FREE(collist);
 }
@@ -339,6 +333,7 @@ void release2(){
 }
 
 void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	Real beta;
 	int count = 0;
 	Timer* timer = new CPUTimer;
@@ -349,12 +344,11 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 
 	// Initialisation by solving the intial network shortest paths
 	ShortestPathOracle DA(net);
-	FOR(a, A)
-		DA.set_cost(net.arcs[a].head, 
-		            net.arcs[a].tail, 
-		            cost_t(net.arcs[a].cost));
+	DenseArcVector c0(A);
+	FOR(a, A) c0[a] = net.arcs[a].cost;
+	DA.set_costs(c0);
 
-	DA.get_flows(x1, settings.geti("memory parsimony level")>=2);
+	DA.get_flows(x1);
 
 	Real f0, f1 = obj->f(x1); 
 	beta = settings.getr("initial beta") * sqrt(x1.dot(x1));
@@ -382,20 +376,21 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 	                "lambda*", "tau*0",     "tau*n",
 	                "t_SP", "obj_ls",  "obj_final", "cosine", "t_elapsed", "peak_mem", "NZ");
 
-	Vector g0(A), g1(A), y0(A);
-	Vector y1(obj->reduced_variable(x1));
-	Function *robj = obj->reduced_function();	
+	DenseArcVector g0(A), g1(A), y0(A);
+	DenseArcVector y1(obj->reduced_variable(x1));
+	ReducedFunction *robj = obj->reduced_function();	
 
 	// Loops
 	Real taubound = -1, taustar = 0.5/5, taustar0 = 1.0;
 	for(int iteration = 1; !exit_flag; iteration++) {
+		pool.reset(); // iteration boundary
 		timer->record(); // Timming
 
 		if(settings.getb("to reset beta")) 
 			beta = settings.getr("initial beta") * x1.norm();
 
-		// Previous best solution
-		x0 = x1; f0 = f1; y0 = y1;
+		// Previous best solution (x1, y1 are recomputed below)
+		x0.swap(x1); f0 = f1; y0.swap(y1);
     
 		// normalized gradient
 		g0 = robj->g(y0);
@@ -414,11 +409,18 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 		y1 = obj->reduced_variable(x1);
 		g1 = robj->g(y1); // g is now gradient at x
 
-		// Optimality check
-		Vector dy(y0); dy -= y1;
-		Real g1dx = g1.dot(dy), g0dx = g0.dot(dy); 
-		Real dxdx = x0.squaredNorm() + x1.squaredNorm() - 2*x0.dot(x1);
-		Real g1g1 = K*g1.squaredNorm(), g0g1 = K*g0.dot(g1), g0g0 = K*g0.squaredNorm();
+		// Optimality check: the arc-space products in one pass over the arcs
+		Real g1dx = 0.0, g0dx = 0.0, g1g1 = 0.0, g0g1 = 0.0, g0g0 = 0.0;
+		FOR(a, A){
+			Real dya = y0[a] - y1[a];
+			g1dx += g1[a]*dya; g0dx += g0[a]*dya;
+			g1g1 += g1[a]*g1[a]; g0g1 += g0[a]*g1[a]; g0g0 += g0[a]*g0[a];
+		}
+		g1g1 *= K; g0g1 *= K; g0g0 *= K;
+		MultiDot mdx;
+		int i_x0x0 = mdx.add(x0, x0), i_x1x1 = mdx.add(x1, x1), i_x0x1 = mdx.add(x0, x1);
+		mdx.compute();
+		Real dxdx = mdx[i_x0x0] + mdx[i_x1x1] - 2*mdx[i_x0x1];
 		Real cosine = 1 + ( (g1dx - beta*g0g1) /
 		                    sqrt((dxdx - 2*beta*g0dx + beta*beta*g0g0)*g1g1) );
 
@@ -432,8 +434,8 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 		if(do_line_search){
 			lambda = section_search (y0, y1, robj, 
 			                         settings.geti("line search iterations"));
-			x1 *= lambda; x0 *= (1-lambda); x1 += x0;
-			y1 *= lambda; y0 *= (1-lambda); y1 += y0;
+			x1.lerp(x0, x1, lambda);
+			y1.lerp(y0, y1, lambda);
 			f1 = robj->f(y1);
 		}
     
@@ -445,20 +447,15 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 			updatemin(tau, 1.0);
 			FOR(iter, settings.geti("SP iterations per SOCP")) {
 				g1 = robj->g(y1);
-				DA.reset_cost();
 				
-				ITER(g1, itg1)
-					DA.set_cost ( net.arcs[itg1.index()].head,
-					              net.arcs[itg1.index()].tail,
-					              cost_t(itg1.value()));
-				DA.get_flows(x0, settings.geti("memory parsimony level")>=2);
-				y0 = obj->reduced_variable(x0);
+				DA.set_costs(g1);
+				DA.get_flows(x0, y0);
 				
 				taustar = section_search(y1, y0, robj, 
 				                         settings.geti("line search iterations"),
 				                         false, tau*(1-PHI), tau*PHI);
-				x1 *= (1-taustar); x0 *= taustar; x1 += x0;
-				y1 *= (1-taustar); y0 *= taustar; y1 += y0;
+				x1.lerp(x1, x0, taustar);
+				y1.lerp(y1, y0, taustar);
 				if(iter == 0) taustar0 = taustar;
 			}
 			
@@ -481,6 +478,17 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 		              timer->elapsed(), f_ls, f1, cosine, timer->elapsed(0,-1),
 		              memory_usage(), x1.nonZeros());
 
+		// Support pruning
+		int period = settings.geti("pruning period");
+		if(period > 0 && iteration % period == 0){
+			int nnz = x1.nonZeros();
+			prune_flows(net, DA, x1, settings.getr("pruning threshold"));
+			y1 = obj->reduced_variable(x1);
+			f1 = robj->f(y1);
+			iteration_report << "Pruning: NNZ " << nnz << " -> " << x1.nonZeros()
+			                 << "; obj = " << f1 << endl;
+		}
+
 		if(taustar == 0.0) taustar = 1.0; 
       
 	}
@@ -495,11 +503,14 @@ void solve(const MultiCommoNetwork &net, ReducableFunction *obj){
 	iteration_report << "Optimal objective = " 
 	                 << scientific << setprecision(12) << obj->f(x1)
 	                 << endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete robj;
 	delete timer;
 }
 
 void solve_KL(const MultiCommoNetwork &net){
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	KleinrockFunction *obj = new KleinrockFunction(net);
 	Real beta;
 	int count = 0;
@@ -540,31 +551,31 @@ void solve_KL(const MultiCommoNetwork &net){
 	                "lambda*", "tau*0",     "tau*n",
 	                "t_SP", "obj_ls",  "obj_final", "cosine", "t_elapsed", "peak_mem");
 
-	Vector g(A*K), z(A*K), y0(A*K);
-	Vector y1(obj->reduced_variable(x1));
-	Function *robj = obj->reduced_function();
+	Vector g(A*K), z(A*K);
+	DenseArcVector y0(A), y1(obj->reduced_variable(x1));
+	ReducedFunction *robj = obj->reduced_function();
 
 	init(net);
 
 	// Loops
 	Real taubound = -1, taustar = 0.5/5, taustar0 = 1.0;
 	for(int iteration = 1; !exit_flag; iteration++) {
+		pool.reset(); // iteration boundary
 		if(settings.getb("to reset beta")) 
 			beta = settings.getr("initial beta") * sqrt(x1.dot(x1));
 
 		// Timing and Reporting
 		timer->record();
 
-		// Previous best solution
-		x0 = x1; f0 = f1; y0 = y1;
+		// Previous best solution (y1 is recomputed below; x1 is not, so copy it)
+		x0 = x1; f0 = f1; y0.swap(y1);
     
 		// normalized gradient
 		g = obj->g(x0);
 		g *= (1/sqrt(g.dot(g)));
 
 		for(count = 1;;count++) {
-			z = g; z *= (-beta); z += x0;
-			//z = x0 - beta*g;
+			z.axpby(1.0, x0, -beta, g); // z = x0 - beta*g
 			//socp(net, z, x1);
 			if(check_capacity(net, x1)){
 				f1 = obj->f(x1);
@@ -578,7 +589,10 @@ void solve_KL(const MultiCommoNetwork &net){
 		// Optimality check
 		g = obj->g(x1); // g is now gradient at x1
 		z -= x1; // z is now z - x1
-		Real cosine = 1 + (z.dot(g))/sqrt((z.dot(z))*(g.dot(g)));
+		MultiDot md;
+		int zg = md.add(z, g), zz = md.add(z, z), gg = md.add(g, g);
+		md.compute();
+		Real cosine = 1 + md[zg]/sqrt(md[zz]*md[gg]);
 		exit_flag = cosine  <= settings.getr("optimality epsilon"); 
     
 		timer->record(); // for timing
@@ -592,10 +606,8 @@ void solve_KL(const MultiCommoNetwork &net){
 		if(do_line_search){
 			lambda = section_search (y0, y1, robj, 
 			                         settings.geti("line search iterations"));
-			//x1 = x0 + lambda*(x1-x0);
-			//y1 = y0 + lambda*(y1-y0);
-			x1 -= x0; x1 *= lambda; x1 += x0;
-			y1 -= y0; y1 *= lambda; y1 += y0;
+			x1.lerp(x0, x1, lambda); // x1 = x0 + lambda*(x1-x0)
+			y1.lerp(y0, y1, lambda); // y1 = y0 + lambda*(y1-y0)
 			f1 = robj->f(y1);
 		}
     
@@ -606,23 +618,17 @@ void solve_KL(const MultiCommoNetwork &net){
 		double tau = taustar0*20;
 		updatemin(tau, 1.0);
 		FOR(iter, settings.geti("SP iterations per SOCP")) {
-			Vector gy(robj->g(y1));
-			DA.reset_cost();
-			ITER(gy, itgy)
-				DA.set_cost(net.arcs[itgy.index()].head,
-				            net.arcs[itgy.index()].tail,
-				            cost_t(itgy.value()));
-			DA.get_flows(sp);
-
-			Vector ysp(obj->reduced_variable(sp));
+			DenseArcVector gy(robj->g(y1));
+			DA.set_costs(gy);
+			DenseArcVector ysp(A);
+			DA.get_flows(sp, ysp);
+
 			taustar = section_search(y1, ysp, robj, 
 			                         settings.geti("line search iterations"),
 			                         false, tau*(1-PHI), tau*PHI);
 
-			//x1 += taustar*(sp-x1);  
-			x1 -= sp;  x1 *= (1-taustar); x1 += sp; 
-			//y1 += taustar*(ysp-y1); 
-			y1 -= ysp; y1 *= (1-taustar); y1 += ysp;
+			x1.lerp(x1, sp, taustar);  // x1 += taustar*(sp-x1)
+			y1.lerp(y1, ysp, taustar); // y1 += taustar*(ysp-y1)
 
 			if(iter == 0) taustar0 = taustar;
 		}
@@ -653,92 +659,138 @@ void solve_KL(const MultiCommoNetwork &net){
 	tr.print_line(iteration_report);
 	tr.print_line(cout);
 	iteration_report<<"Optimal objective: "<<scientific<<setprecision(12)<<obj->f(x1)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	delete obj;
 }
 
 Vector solve_by_dijkstra(const MultiCommoNetwork &net, Function *obj)
 {
+	SparseBufferPool pool; // recycles vector buffers across iterations
 	int V = net.getNVertex(), A = net.arcs.size(), K = net.commoflows.size();
 	ShortestPathOracle DA(net);
 	Timer *timer = new CPUTimer();
-	Vector x(A*K), sp(A*K);
+	Vector x(A*K), sp(A*K), delta(A*K);
+
+	// dynamic mode: the trees are repaired after each cost update and
+	// sp is updated by the paths that changed
+	bool dynamic = settings.getb("dynamic shortest paths");
+	DA.set_dynamic(dynamic);
 
 	timer->record();
 
 	// Initialisation by solving the intial network shortest paths
-	FOR(a, A) 
-		DA.set_cost(net.arcs[a].head, 
-		            net.arcs[a].tail, 
-		            cost_t(net.arcs[a].cost));
+	DenseArcVector c0(A);
+	FOR(a, A) c0[a] = net.arcs[a].cost;
+	DA.set_costs(c0);
 	DA.get_flows(x);
 
 	// header row of the iteration report
-	TableReport tr("%-5d%8.4f%8.4f%8.4f%8.4f%20.10e%12.3f");
+	TableReport tr("%-5d%8.4f%8.4f%8.4f%8.4f%20.10e%12.3f%10.2f%12.3e");
 	tr.print_header(&iteration_report, 
 	                "Iter", "t_total", "t_SP", "t_LS", 
-	                "tau", "obj", "t_elapsed");
+	                "tau", "obj", "t_elapsed", "saved_MB", "drift");
   
 	// If obj is reducable, a more efficient algorithm is used
 	ReducableFunction *cobj = dynamic_cast<ReducableFunction*>(obj);
-	Function * robj = NULL;
-	Vector y(A);
+	ReducedFunction * robj = NULL;
+	DenseArcVector y(A);
 	Real tau = 1.0;
 	if(cobj) robj = cobj->reduced_function(), y = cobj->reduced_variable(x);
 
+	// Compact storage: the iterate is kept in single precision while the
+	// arc totals y stay in double; the objective at the rounded iterate is
+	// compared against f(y) to report the drift. Only the reduced path
+	// keeps x in compact form (the general path needs obj->g(x)).
+	bool compact = cobj && settings.getb("compact flow storage");
+	CompactSparseVector xc(A*K);
+	if(compact){
+		xc = x;
+		Vector(A*K).swap(x); // give back the double precision storage
+	}
+
 	FOR(iteration, settings.geti("SP iterations")) {
+		pool.reset(); // iteration boundary
 		cout<<"Iteration "<<iteration<<endl;
 		timer->record();
     
 		if(cobj){
-			Vector g(robj->g(y));
-			ITER(g, itg) 
-				DA.set_cost(net.arcs[itg.index()].head, 
-				            net.arcs[itg.index()].tail, 
-				            cost_t(itg.value()));
-			DA.get_flows(sp);
+			DenseArcVector g(robj->g(y));
+			DA.set_costs(g);
+			// the arc totals of sp are loaded from the trees
+			DenseArcVector ysp(A);
+			if(dynamic) DA.get_flow_changes(delta), sp += delta, DA.get_arc_flows(ysp);
+			else DA.get_flows(sp, ysp);
 			timer->record();
 
-			Vector ysp(cobj->reduced_variable(sp));      
 			if(4*tau >= 1.0) tau = 0.25;
 			tau = section_search(y, ysp, robj, 
 			                     settings.geti("line search iterations"), 
 			                     false,
 			                     4*tau*(1-PHI), 4*tau*PHI);
-			x *= (1-tau);  sp *= tau; x += sp;
-			y *= (1-tau); ysp *= tau; y += ysp;
+			if(compact) xc = xc + tau*(sp - xc);
+			else x.lerp(x, sp, tau);
+			y.lerp(y, ysp, tau);
 		}
 		else{
 			Vector g(obj->g(x));
-			FOR(a, A) 
-				DA.set_cost(net.arcs[a].head, 
-				            net.arcs[a].tail, 
-				            cost_t(g.coeff(a*K)));
-			DA.get_flows(sp);
+			DenseArcVector ga(A);
+			FOR(a, A) ga[a] = g.coeff(a*K);
+			DA.set_costs(ga);
+			if(dynamic) DA.get_flow_changes(delta), sp += delta;
+			else DA.get_flows(sp);
 			timer->record();
       
 			if(4*tau >= 1.0) tau = section_search(x, sp, obj);
 			else tau = section_search(x, sp, obj, 
 			                          settings.geti("line search iterations"), 
 			                          false, 4*tau*(1-PHI), 4*tau*PHI);
-			sp *= tau; x*= (1-tau); x += sp;
+			x.lerp(x, sp, tau);
 		}
 
 		timer->record();
       
 		// Timing and Reporting
-		if(iteration%settings.geti("SP iterations per report") == 0)
+		if(iteration%settings.geti("SP iterations per report") == 0){
+			Real fx, saved = 0.0, drift = 0.0;
+			if(compact){
+				DenseArcVector yc(arc_totals(xc, A, K));
+				fx = robj->f(yc);
+				drift = fx - robj->f(y);
+				saved = (xc.double_memory() - xc.memory())/1e6;
+			}
+			else fx = obj->f(x);
 			tr.print_row(&iteration_report, 
 			             iteration+1, timer->elapsed(-1,-3), timer->elapsed(-2,-3),
-			             timer->elapsed(-2,-1), tau, obj->f(x), timer->elapsed(0,-1));
+			             timer->elapsed(-2,-1), tau, fx, timer->elapsed(0,-1),
+			             saved, drift);
+		}
+
+		// Support pruning
+		int period = settings.geti("pruning period");
+		if(period > 0 && (iteration+1) % period == 0){
+			if(compact) x = xc;
+			int nnz = x.nonZeros();
+			prune_flows(net, DA, x, settings.getr("pruning threshold"));
+			iteration_report << "Pruning: NNZ " << nnz << " -> " << x.nonZeros() << endl;
+			if(cobj) y = cobj->reduced_variable(x);
+			if(compact){
+				xc = x;
+				Vector(A*K).swap(x);
+			}
+		}
 	}
   
 	if(robj) delete robj;
+	if(compact) x = xc;
   
 	// Reporting final results
 	tr.print_line(iteration_report);
 	iteration_report<<"Optimal objective: "
 	                <<scientific<<setprecision(12)<<obj->f(x)<<endl;
+	iteration_report << "Vector buffers: " << pool.nhits() << " reused, "
+	                 << pool.nmisses() << " allocated" << endl;
 	delete timer;
 	return x;  
 }
@@ -799,6 +851,15 @@ int main(){
   
 	MultiCommoNetwork net(inputname.c_str(), format);
 
+	// vertex order for locality of the shortest path labels
+	string order = settings.gets("vertex order");
+	if(order != "file"){
+		double before = net.label_span();
+		net.renumber(order);
+		iteration_report << "Renumbering (" << order << "): mean label span of the arcs "
+		                 << before << " -> " << net.label_span() << endl << endl;
+	}
+
 	cout<<"Solving"<<endl;
 	timer->record();
 
@@ -103,51 +103,10 @@ class SettingMapper{
 
 
 /**
- * Some utility functions to work with vector
+ * Vector arithmetic (x + y, x - y, a*x, dot) is provided lazily by the
+ * expression templates in my_sparse_expr.h
  */
 
-/*
-  inline Vector operator + (const Vector &x, const Vector &y){
-  Vector z(x);
-  FOR(i, x.size()) z[i] += y[i];
-  return z;
-  }
-
-  inline Vector operator - (const Vector &x, const Vector &y){
-  Vector z(x);
-  FOR(i, x.size()) z[i] -= y[i];
-  return z;
-  }
-
-  inline Vector & operator += (Vector &x, const Vector &y){
-  FOR(i, x.size()) x[i] += y[i];
-  return x;
-  }
-
-  inline Vector & operator -= (Vector &x, const Vector &y){
-  FOR(i, x.size()) x[i] -= y[i];
-  return x;
-  }
-
-  inline Vector & operator *= (Vector &x, Real alpha){
-  FOR(i, x.size()) x[i] *= alpha;
-  return x;
-  }
-
-  inline Real operator * (const Vector &x, const Vector &y){
-  Real sum = 0.0;
-  FOR(i, x.size()) sum += x[i]*y[i];
-  return sum;
-  }
-
-  inline Vector operator *(Real alpha, const Vector &x){
-  Vector z(x);
-  z*=alpha;
-  return z;
-  }
-
-*/
-
 //bool operator == (const Vector &x, const Vector &y);
 
 template <typename T> inline bool updatemin(T &a, T b){
@@ -0,0 +1,120 @@
+#include "dense_arc_vector.h"
+
+void DenseArcVector::allocate(int n_){
+	n = n_;
+	v = NULL;
+	if(n > 0 && posix_memalign((void**) &v, ALIGNMENT, n*sizeof(double)))
+		error_handle("DenseArcVector: out of memory");
+}
+
+DenseArcVector::DenseArcVector(int n_){
+	allocate(n_);
+	fill(0.0);
+}
+
+DenseArcVector::DenseArcVector(const DenseArcVector &x){
+	allocate(x.n);
+	if(n) memcpy(v, x.v, n*sizeof(double));
+}
+
+DenseArcVector::DenseArcVector(const Vector &x){
+	allocate(x.size());
+	fill(0.0);
+	ITER(x, itx) v[itx.index()] = itx.value();
+}
+
+DenseArcVector& DenseArcVector::operator = (const DenseArcVector &x){
+	if(this == &x) return *this;
+	if(n != x.n){
+		free(v);
+		allocate(x.n);
+	}
+	if(n) memcpy(v, x.v, n*sizeof(double));
+	return *this;
+}
+
+DenseArcVector::~DenseArcVector(){
+	free(v);
+}
+
+void DenseArcVector::swap(DenseArcVector &x){
+	std::swap(v, x.v);
+	std::swap(n, x.n);
+}
+
+#if __cplusplus >= 201103L
+DenseArcVector::DenseArcVector(DenseArcVector &&x) : v(x.v), n(x.n) {
+	x.v = NULL;
+	x.n = 0;
+}
+
+DenseArcVector& DenseArcVector::operator = (DenseArcVector &&x){
+	swap(x);
+	return *this;
+}
+#endif
+
+void DenseArcVector::fill(double c){
+	FOR(a, n) v[a] = c;
+}
+
+DenseArcVector& DenseArcVector::operator *= (double c){
+	FOR(a, n) v[a] *= c;
+	return *this;
+}
+
+DenseArcVector& DenseArcVector::axpby(double a, const DenseArcVector &x, double b, const DenseArcVector &y){
+	assert(x.n == y.n);
+	if(n != x.n) *this = DenseArcVector(x.n);
+	const double *px = x.v, *py = y.v;
+	FOR(i, n) v[i] = a*px[i] + b*py[i];
+	return *this;
+}
+
+DenseArcVector& DenseArcVector::lerp(const DenseArcVector &x, const DenseArcVector &y, double t){
+	assert(x.n == y.n);
+	if(n != x.n) *this = DenseArcVector(x.n);
+	const double *px = x.v, *py = y.v;
+	FOR(i, n) v[i] = px[i] + t*(py[i] - px[i]);
+	return *this;
+}
+
+DenseArcVector& DenseArcVector::combine(double a, const DenseArcVector &x,
+                                        double b, const DenseArcVector &y,
+                                        double c, const DenseArcVector &z){
+	assert(x.n == y.n && y.n == z.n);
+	if(n != x.n) *this = DenseArcVector(x.n);
+	const double *px = x.v, *py = y.v, *pz = z.v;
+	FOR(i, n) v[i] = a*px[i] + b*py[i] + c*pz[i];
+	return *this;
+}
+
+double DenseArcVector::dot(const DenseArcVector &x) const{
+	assert(x.n == n);
+	double s0 = 0.0, s1 = 0.0;
+	int i = 0;
+	for(; i+2 <= n; i += 2) s0 += v[i]*x.v[i], s1 += v[i+1]*x.v[i+1];
+	if(i < n) s0 += v[i]*x.v[i];
+	return s0 + s1;
+}
+
+double DenseArcVector::squaredNorm() const{
+	return dot(*this);
+}
+
+double DenseArcVector::norm() const{
+	return sqrt(squaredNorm());
+}
+
+Vector DenseArcVector::sparse() const{
+	Vector x(n);
+	FOR(a, n) if(v[a] != 0.0) x.insert(a) = v[a];
+	return x;
+}
+
+Vector DenseArcVector::expand(int K) const{
+	Vector x(n*K);
+	for(int a = 0, base = 0; a < n; a++, base += K)
+		if(v[a] != 0.0) FOR(k, K) x.insert(base + k) = v[a];
+	return x;
+}
@@ -0,0 +1,73 @@
+#ifndef __DENSE_ARC_VECTOR_H__
+#define __DENSE_ARC_VECTOR_H__
+
+#include "cvputility.h"
+
+using namespace std;
+
+// Dense vector over the arcs of a network (reduced variables, their
+// gradients and Hessian diagonals). Every arc has an entry, so the values
+// live in one contiguous, 64-byte aligned array and all operations are
+// plain loops that the compiler can vectorise.
+class DenseArcVector {
+ private:
+	static const int ALIGNMENT = 64;
+
+	double *v;
+	int n;
+
+	void allocate(int n);
+
+ public:
+	explicit DenseArcVector(int n = 0); // all zeros
+	DenseArcVector(const DenseArcVector &);
+	explicit DenseArcVector(const Vector &); // densify a sparse vector
+	DenseArcVector & operator = (const DenseArcVector &);
+	~DenseArcVector();
+
+	void swap(DenseArcVector &);
+
+#if __cplusplus >= 201103L
+	DenseArcVector(DenseArcVector &&);
+	DenseArcVector & operator = (DenseArcVector &&);
+#endif
+
+	inline int size() const { return n; }
+	inline double & operator [] (int a) { return v[a]; }
+	inline double operator [] (int a) const { return v[a]; }
+	inline double *data() { return v; }
+	inline const double *data() const { return v; }
+
+	void fill(double c);
+	DenseArcVector & operator *= (double);
+
+	// this = a*x + b*y; x and/or y may alias this
+	DenseArcVector & axpby(double a, const DenseArcVector &x, double b, const DenseArcVector &y);
+	// this = x + t*(y-x)
+	DenseArcVector & lerp(const DenseArcVector &x, const DenseArcVector &y, double t);
+	// this = a*x + b*y + c*z; x, y and/or z may alias this
+	DenseArcVector & combine(double a, const DenseArcVector &x,
+	                         double b, const DenseArcVector &y,
+	                         double c, const DenseArcVector &z);
+
+	double dot(const DenseArcVector &) const;
+	double squaredNorm() const;
+	double norm() const;
+
+	// sparse copy (zeros dropped)
+	Vector sparse() const;
+	// flow-space vector of size n*K with x[a*K+k] = this[a] for every k
+	Vector expand(int K) const;
+};
+
+inline void swap(DenseArcVector &x, DenseArcVector &y){
+	x.swap(y);
+}
+
+namespace std {
+	template <> inline void swap(DenseArcVector &x, DenseArcVector &y){
+		x.swap(y);
+	}
+}
+
+#endif
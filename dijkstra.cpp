@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
 #include "dijkstra.h"
 
-#define int(i) (int)(i)
 #define FOR(i, n) for((i)=0; (i)<(n); (i)++)
 #define MALLOC(type, size) ((type*) malloc((size)*sizeof(type)))
 #define FREE(var)				\
@@ -17,100 +19,557 @@ void malloc_adjl(AdjacentList *al){
   (*al).costs = MALLOC(cost_t, (*al).A);
 }
 
-void index_adjl(AdjacentList al, arc_t *index){
-  vertex_t i, j, V = al.V;
-  arc_t a, A = al.A;
-  FOR(i, V) FOR(j, V) index[int(i)*V + j] = -1;
-  FOR(i, V) for(a = al.n_arcs[i]; a<al.n_arcs[i+1]; a++)
-    index[int(i)*V + al.adjacent_vertices[a]] = a;
-}
-
 void free_adjl(AdjacentList *al){
   FREE((*al).n_arcs);
   FREE((*al).adjacent_vertices);
   FREE((*al).costs);
 }
 
+vertex_t *build_tails(AdjacentList al){
+  vertex_t u, *tails = MALLOC(vertex_t, al.A);
+  arc_t i;
+  FOR(u, al.V) for(i = al.n_arcs[u]; i < al.n_arcs[u+1]; i++) tails[i] = u;
+  return tails;
+}
+
+void free_tails(vertex_t *tails){
+  FREE(tails);
+}
+
+InArcs build_in_arcs(AdjacentList al){
+  InArcs in;
+  int v, i;
+  in.first = MALLOC(arc_t, al.V + 1);
+  in.arcs = MALLOC(arc_t, al.A);
+  FOR(v, al.V + 1) in.first[v] = 0;
+  FOR(i, al.A) in.first[al.adjacent_vertices[i] + 1]++;
+  FOR(v, al.V) in.first[v+1] += in.first[v];
+  /* fill in.arcs with in.first[w] as the cursor of w, then shift back */
+  FOR(i, al.A) in.arcs[in.first[al.adjacent_vertices[i]]++] = i;
+  for(v = al.V; v > 0; v--) in.first[v] = in.first[v-1];
+  in.first[0] = 0;
+  return in;
+}
+
+void free_in_arcs(InArcs *in){
+  FREE((*in).first);
+  FREE((*in).arcs);
+}
+
+/* Queue policies. A queue holds labelled vertices keyed by their current
+   distance d[v] and provides
+     begin(d)        start a search on the distance array d (empties it)
+     push(v)         insert a newly labelled vertex
+     decrease(v, o)  d[v] dropped from o; reinserts v if it was popped
+     pop()           remove and return the next vertex, -1 if none
+     forget(v)       v is not in the queue (discards stale state of v)
+   LABEL_SETTING tells whether popped vertices are final, which allows
+   the search to stop once all targets have been popped. */
+
+typedef unsigned long long ukey_t;
+
+static const double RADIX_UNITS  = 1099511627776.0; /* 2^40 */
+static const int    DIAL_BUCKETS = 4096;
+
+/* D-ary heap with a position index for decrease-key */
+template <int D>
+class DaryHeap {
+  std::vector<vertex_t> heap;
+  std::vector<index_t> pos; /* position in heap, -1 once popped */
+  const cost_t *d;
+  int n;
+
+  void up(int i, vertex_t v){
+    cost_t c = d[v];
+    while(i > 0){
+      int dad = (i-1)/D;
+      vertex_t dv = heap[dad];
+      if(d[dv] <= c) break;
+      heap[i] = dv; pos[dv] = i;
+      i = dad;
+    }
+    heap[i] = v; pos[v] = i;
+  }
+
+  void down(int i, vertex_t v){
+    cost_t c = d[v];
+    for(;;){
+      int child = D*i + 1, last = child + D < n ? child + D : n, best = child;
+      if(child >= n) break;
+      for(int j = child+1; j < last; j++) if(d[heap[j]] < d[heap[best]]) best = j;
+      if(d[heap[best]] >= c) break;
+      heap[i] = heap[best]; pos[heap[i]] = i;
+      i = best;
+    }
+    heap[i] = v; pos[v] = i;
+  }
+
+ public:
+  static const bool LABEL_SETTING = true;
+
+  DaryHeap(vertex_t V) : heap(V), pos(V), d(NULL), n(0) {}
+  void scale(cost_t) {}
+  void begin(const cost_t *d_){ d = d_; n = 0; }
+  void push(vertex_t v){ up(n++, v); }
+  void decrease(vertex_t v, cost_t){
+    if(pos[v] < 0) push(v);
+    else up(pos[v], v);
+  }
+  void forget(vertex_t v){ pos[v] = -1; }
+  vertex_t pop(){
+    if(n == 0) return -1;
+    vertex_t v = heap[0];
+    pos[v] = -1;
+    if(--n > 0) down(0, heap[n]);
+    return v;
+  }
+};
+
+/* Radix heap on integer keys floor(d[v]*unit). Entries are never moved on
+   decrease-key: a new entry is added and the old one is skipped when it
+   comes out (its key no longer matches, or the vertex was popped). Several
+   labels can share a key, so bucket 0 (the keys equal to last) is a heap
+   on the label of each entry: vertices still come out in label order. */
+class RadixHeap {
+  struct Entry {
+    ukey_t k;
+    cost_t d;   /* label when the entry was added */
+    vertex_t v;
+  };
+  struct Later {
+    bool operator () (const Entry &a, const Entry &b) const { return a.d > b.d; }
+  };
+  std::vector<Entry> bucket[65]; /* bucket b: keys whose highest bit differing from last is b-1 */
+  std::vector<char> queued;      /* 1 while v has a live entry */
+  const cost_t *d;
+  double unit;
+  ukey_t last;                   /* key of the last popped vertex */
+  int n;
+
+  ukey_t key(vertex_t v) const { return (ukey_t) (d[v] * unit); }
+  int slot(ukey_t k) const { return k == last ? 0 : 64 - __builtin_clzll(k ^ last); }
+  void add(const Entry &e){
+    int b = slot(e.k);
+    bucket[b].push_back(e);
+    if(b == 0) std::push_heap(bucket[0].begin(), bucket[0].end(), Later());
+  }
+
+ public:
+  static const bool LABEL_SETTING = true;
+
+  RadixHeap(vertex_t V) : queued(V, 0), d(NULL), unit(1.0), last(0), n(0) {}
+  void scale(cost_t maxcost){ unit = maxcost > 0 ? RADIX_UNITS / maxcost : 1.0; }
+  void begin(const cost_t *d_){
+    int b;
+    d = d_;
+    FOR(b, 65) bucket[b].clear();
+    last = 0; n = 0;
+  }
+  void push(vertex_t v){
+    Entry e = { key(v), d[v], v };
+    add(e);
+    queued[v] = 1;
+    n++;
+  }
+  void decrease(vertex_t v, cost_t){ push(v); }
+  void forget(vertex_t v){ queued[v] = 0; }
+  vertex_t pop(){
+    for(;;){
+      if(bucket[0].empty()){
+        /* the smallest key of the first non-empty bucket becomes last;
+           all entries of that bucket then move to lower buckets */
+        int b = 1;
+        size_t i;
+        if(n == 0) return -1;
+        while(bucket[b].empty()) b++;
+        std::vector<Entry> &B = bucket[b];
+        last = B[0].k;
+        for(i = 1; i < B.size(); i++) if(B[i].k < last) last = B[i].k;
+        for(i = 0; i < B.size(); i++) add(B[i]);
+        B.clear();
+      }
+      std::pop_heap(bucket[0].begin(), bucket[0].end(), Later());
+      Entry e = bucket[0].back();
+      bucket[0].pop_back();
+      n--;
+      if(queued[e.v] && key(e.v) == e.k){
+        queued[e.v] = 0;
+        return e.v;
+      }
+    }
+  }
+};
+
+/* Dial's algorithm: circular array of buckets indexed by the integer key
+   floor(d[v]*unit), scanned in increasing key order. An arc spans at most
+   DIAL_BUCKETS+1 keys, so DIAL_BUCKETS+2 buckets never wrap onto live
+   entries. Decrease-key is lazy as in RadixHeap, and as there each bucket
+   is a heap on the labels, so vertices come out in label order. */
+class DialBuckets {
+  struct Entry {
+    cost_t d;   /* label when the entry was added */
+    vertex_t v;
+  };
+  struct Later {
+    bool operator () (const Entry &a, const Entry &b) const { return a.d > b.d; }
+  };
+  std::vector< std::vector<Entry> > bucket;
+  std::vector<int> used;    /* buckets that may be non-empty */
+  std::vector<char> queued;
+  const cost_t *d;
+  double unit;
+  ukey_t cur;               /* key of the bucket being scanned */
+  int n;
+
+  ukey_t key(vertex_t v) const { return (ukey_t) (d[v] * unit); }
+
+ public:
+  static const bool LABEL_SETTING = true;
+
+  DialBuckets(vertex_t V) : bucket(DIAL_BUCKETS + 2), queued(V, 0), d(NULL), unit(1.0), cur(0), n(0) {}
+  void scale(cost_t maxcost){ unit = maxcost > 0 ? DIAL_BUCKETS / maxcost : 1.0; }
+  void begin(const cost_t *d_){
+    size_t i;
+    d = d_;
+    for(i = 0; i < used.size(); i++) bucket[used[i]].clear();
+    used.clear();
+    cur = 0; n = 0;
+  }
+  void push(vertex_t v){
+    int b = key(v) % bucket.size();
+    Entry e = { d[v], v };
+    if(bucket[b].empty()) used.push_back(b);
+    bucket[b].push_back(e);
+    std::push_heap(bucket[b].begin(), bucket[b].end(), Later());
+    queued[v] = 1;
+    n++;
+  }
+  void decrease(vertex_t v, cost_t){ push(v); }
+  void forget(vertex_t v){ queued[v] = 0; }
+  vertex_t pop(){
+    while(n > 0){
+      std::vector<Entry> &B = bucket[cur % bucket.size()];
+      if(B.empty()){ cur++; continue; }
+      std::pop_heap(B.begin(), B.end(), Later());
+      Entry e = B.back();
+      B.pop_back();
+      n--;
+      if(queued[e.v] && key(e.v) == cur){
+        queued[e.v] = 0;
+        return e.v;
+      }
+    }
+    return -1;
+  }
+};
+
+/* Label-correcting deque (Bertsekas): a vertex whose label is smaller than
+   the label at the front is inserted at the front (SLF), and vertices at
+   the front with a label above the queue average are sent to the back
+   before popping (LLL). Vertices may be popped several times. */
+class SlfLllDeque {
+  std::vector<vertex_t> ring; /* circular, ring[head..head+n) */
+  std::vector<char> queued;
+  const cost_t *d;
+  int head, n, cap;
+  double sum;                 /* sum of the labels in the queue */
+
+ public:
+  static const bool LABEL_SETTING = false;
+
+  SlfLllDeque(vertex_t V) : ring(V), queued(V, 0), d(NULL), head(0), n(0), cap(V), sum(0.0) {}
+  void scale(cost_t) {}
+  void begin(const cost_t *d_){ d = d_; head = n = 0; sum = 0.0; }
+  void push(vertex_t v){
+    sum += d[v];
+    queued[v] = 1;
+    if(n > 0 && d[v] < d[ring[head]]){
+      head = head == 0 ? cap-1 : head-1;
+      ring[head] = v;
+    }
+    else ring[(head + n) % cap] = v;
+    n++;
+  }
+  void decrease(vertex_t v, cost_t old){
+    if(queued[v]) sum += d[v] - old;
+    else push(v);
+  }
+  void forget(vertex_t v){ queued[v] = 0; }
+  vertex_t pop(){
+    vertex_t v;
+    int r;
+    if(n == 0) return -1;
+    double avg = sum / n;
+    for(r = 0; r < n && d[ring[head]] > avg; r++){
+      ring[(head + n) % cap] = ring[head];
+      head = (head + 1) % cap;
+    }
+    v = ring[head];
+    head = (head + 1) % cap;
+    n--;
+    sum -= d[v];
+    queued[v] = 0;
+    return v;
+  }
+};
+
+struct DijkstraQueue_ {
+  queue_kind kind;
+  void *impl;
+  DaryHeap<4> *repair; /* Dial's buckets need nearly monotone seeds, so
+                          repairs with QUEUE_DIAL use a 4-ary heap */
+};
+
+DijkstraQueue *new_queue(queue_kind kind, vertex_t V){
+  DijkstraQueue *q = MALLOC(DijkstraQueue, 1);
+  q->kind = kind;
+  q->repair = kind == QUEUE_DIAL ? new DaryHeap<4>(V) : NULL;
+  switch(kind){
+  case QUEUE_BINARY:  q->impl = new DaryHeap<2>(V); break;
+  case QUEUE_4ARY:    q->impl = new DaryHeap<4>(V); break;
+  case QUEUE_RADIX:   q->impl = new RadixHeap(V); break;
+  case QUEUE_DIAL:    q->impl = new DialBuckets(V); break;
+  default:            q->impl = new SlfLllDeque(V); q->kind = QUEUE_SLF_LLL; break;
+  }
+  return q;
+}
+
+void free_queue(DijkstraQueue *q){
+  if(!q) return;
+  switch(q->kind){
+  case QUEUE_BINARY:  delete (DaryHeap<2>*) q->impl; break;
+  case QUEUE_4ARY:    delete (DaryHeap<4>*) q->impl; break;
+  case QUEUE_RADIX:   delete (RadixHeap*) q->impl; break;
+  case QUEUE_DIAL:    delete (DialBuckets*) q->impl; break;
+  default:            delete (SlfLllDeque*) q->impl; break;
+  }
+  delete q->repair;
+  free(q);
+}
+
+queue_kind queue_type(const DijkstraQueue *q){
+  return q->kind;
+}
+
+const char *queue_name(queue_kind kind){
+  static const char *names[QUEUE_KINDS] = { "binary", "4-ary", "radix", "dial", "slf-lll" };
+  return kind >= 0 && kind < QUEUE_KINDS ? names[kind] : "unknown";
+}
+
+void scale_queue(DijkstraQueue *q, cost_t maxcost){
+  switch(q->kind){
+  case QUEUE_BINARY:  ((DaryHeap<2>*) q->impl)->scale(maxcost); break;
+  case QUEUE_4ARY:    ((DaryHeap<4>*) q->impl)->scale(maxcost); break;
+  case QUEUE_RADIX:   ((RadixHeap*) q->impl)->scale(maxcost); break;
+  case QUEUE_DIAL:    ((DialBuckets*) q->impl)->scale(maxcost); break;
+  default:            ((SlfLllDeque*) q->impl)->scale(maxcost); break;
+  }
+}
+
+template <class Q>
+static void search ( AdjacentList adjl,
+		     vertex_t u,
+		     char *vb,
+		     vertex_t nv,
+		     Q &q,
+		     cost_t *d,
+		     arc_t *pred,
+		     unsigned *stamp,
+		     unsigned epoch )
+{
+  vertex_t v, w;
+  arc_t i;
+  cost_t c, cw, old;
+
+  // Initialisation
+  stamp[u] = epoch; pred[u] = -1; d[u] = 0;
+  q.begin(d);
+  q.push(u);
+
+  while((v = q.pop()) >= 0){
+    if(vb[v]){
+      vb[v] = 0;
+      if(Q::LABEL_SETTING && --nv == 0) return;
+    }
+
+    // loop over all adjacent vertices of the new vertex
+    c = d[v];
+    for(i = adjl.n_arcs[v]; i < adjl.n_arcs[v+1]; i++){
+      w = adjl.adjacent_vertices[i];
+      cw = c + adjl.costs[i];
+
+      if(stamp[w] != epoch){
+	// this is a new vertex
+	stamp[w] = epoch;
+	d[w] = cw; pred[w] = i;
+	q.push(w);
+      }
+      else if(cw < d[w]){
+	// cost reduction
+	old = d[w];
+	d[w] = cw; pred[w] = i;
+	q.decrease(w, old);
+      }
+    }
+  }
+}
+
 void dijkstra ( AdjacentList adjl,		
 		vertex_t u,
 		char *vb,
 		vertex_t nv,
-		
-		vertex_t *heap,
-		index_t *pos,
+		DijkstraQueue *q,
 		cost_t *d,
-		
-		vertex_t *trace ) 
+		arc_t *pred,
+		unsigned *stamp,
+		unsigned epoch ) 
 {
-  vertex_t i, dadvertex, childvertex, childvertex2;
-  index_t dad, child, heapsize = 1;
-  cost_t c, dadcost, childcost, childcost2;
+  switch(q->kind){
+  case QUEUE_BINARY:
+    search(adjl, u, vb, nv, *(DaryHeap<2>*) q->impl, d, pred, stamp, epoch); break;
+  case QUEUE_4ARY:
+    search(adjl, u, vb, nv, *(DaryHeap<4>*) q->impl, d, pred, stamp, epoch); break;
+  case QUEUE_RADIX:
+    search(adjl, u, vb, nv, *(RadixHeap*) q->impl, d, pred, stamp, epoch); break;
+  case QUEUE_DIAL:
+    search(adjl, u, vb, nv, *(DialBuckets*) q->impl, d, pred, stamp, epoch); break;
+  default:
+    search(adjl, u, vb, nv, *(SlfLllDeque*) q->impl, d, pred, stamp, epoch); break;
+  }
+}
 
-  // Initialisation
-  for(i = 0; i < adjl.V; i++) pos[i] = -1, trace[i] = -1;  
-  d[u] = 0; heap[0] = u; pos[u] = 0;
-  
-  while(nv>0 && heapsize>0) {
-    c = d[u = heap[0]];
-    if(vb[u]) if((--nv) == 0) return;
-
-    //////////////////////////////////////////////////////////////////
-    // pop heap (upheap)
-    //
-    pos[ heap[dad = 0] = (dadvertex = heap[--heapsize]) ] = 0;
-    dadcost = d[dadvertex];
-    while( (child=dad*2+1) < heapsize-1){
-      childcost  = d[childvertex  = heap[child]];
-      childcost2 = d[childvertex2 = heap[child+1]];
-      if(childcost2 < childcost) 
-	child++, childvertex = childvertex2, childcost = childcost2;
-      if(childcost > dadcost) break;
-      heap[dad] = childvertex; pos[childvertex] = dad;
-      dad = child;
+/* relaxes arc i = (v, w), recording w the first time its tree arc moves */
+#define RELAX(v, i, w)						\
+  do{								\
+    cw = d[v] + adjl.costs[i];					\
+    if(cw < d[w]){						\
+      if(stamp[w] != epoch){					\
+	stamp[w] = epoch; touched[nt++] = w; oldpred[w] = pred[w];	\
+	q.forget(w);						\
+      }								\
+      dw = d[w]; d[w] = cw; pred[w] = i;			\
+      q.decrease(w, dw);					\
+    }								\
+  }while(0)
+
+template <class Q>
+static int repair ( AdjacentList adjl,
+		    const vertex_t *tails,
+		    InArcs in,
+		    vertex_t u,
+		    const arc_t *changed,
+		    const cost_t *old,
+		    int m,
+		    Q &q,
+		    cost_t *d,
+		    arc_t *pred,
+		    unsigned *stamp,
+		    unsigned epoch,
+		    vertex_t *touched,
+		    arc_t *oldpred )
+{
+  int j, h, nt = 0;
+  vertex_t v, w;
+  arc_t i, e;
+  cost_t cw, dw;
+
+  q.begin(d);
+
+  /* detach the subtrees below the tree arcs that became costlier: their
+     vertices are listed in touched[0..nt) and lose their labels */
+  FOR(j, m){
+    i = changed[j];
+    w = adjl.adjacent_vertices[i];
+    if(adjl.costs[i] <= old[j] || pred[w] != i) continue;
+    h = nt;
+    stamp[w] = epoch; touched[nt++] = w; oldpred[w] = pred[w];
+    for(; h < nt; h++){
+      v = touched[h];
+      for(e = adjl.n_arcs[v]; e < adjl.n_arcs[v+1]; e++){
+	w = adjl.adjacent_vertices[e];
+	if(pred[w] == e && stamp[w] != epoch){
+	  stamp[w] = epoch; touched[nt++] = w; oldpred[w] = pred[w];
+	}
+      }
+      d[v] = COST_INF; pred[v] = -1;
+      q.forget(v);
     }
-    
-    if(child == heapsize-1)
-      if(d[childvertex = heap[child]] < dadcost){
-	heap[dad] = heap[child];
-	pos[childvertex] = dad;
-	dad = child;
-      }    
-    heap[dad] = dadvertex; pos[dadvertex] = dad;
-    /////// end pop heap /////////////////////////////////////////////
+  }
 
-    // loop over all adjacent vertices of the new vertex
-    for(i = adjl.n_arcs[u]; i < adjl.n_arcs[u+1]; i++){
-      childvertex = adjl.adjacent_vertices[i];
-      childcost = c + adjl.costs[i];
-
-      // check new vertex and/or cost reduction
-      if(pos[childvertex] < 0){
-	// this is a new vertex, insert to the end of the heap
-	heap[child = heapsize] = childvertex;
-	pos[childvertex] = heapsize++;
-      } 
-      else if (childcost >= d[childvertex]) continue; // no cost reduction
-      else child = pos[childvertex]; // cost reduction
-      
-      // update cost and trace
-      trace[childvertex] = u;
-      d[childvertex] = childcost;
-      
-      //////////////////////////////////////////////////////////////////
-      // update heap (upheap)
-      //
-      while(child > 0) {
-	dadcost = d[dadvertex = heap[dad = (child-1)/2]];
-	if(dadcost < childcost) break;
-	heap[child] = dadvertex; pos[dadvertex] = child;
-	child = dad;
+  /* and take them up again from the best arc coming from the rest of the
+     tree, found from whichever side of the boundary is smaller; the inside
+     of the subtrees is left to the search */
+  if(2*nt <= adjl.V){
+    FOR(h, nt){
+      w = touched[h];
+      for(e = in.first[w]; e < in.first[w+1]; e++){
+	i = in.arcs[e];
+	v = tails[i];
+	if(stamp[v] == epoch || d[v] >= COST_INF) continue;
+	cw = d[v] + adjl.costs[i];
+	if(cw < d[w]) d[w] = cw, pred[w] = i;
       }
-      heap[child] = childvertex; pos[childvertex] = child;
-      /////// end upheap ///////////////////////////////////////////////
     }
   }
+  else if(nt > 0){
+    for(v = 0; v < adjl.V; v++){
+      if(stamp[v] == epoch || d[v] >= COST_INF) continue;
+      for(i = adjl.n_arcs[v]; i < adjl.n_arcs[v+1]; i++){
+	w = adjl.adjacent_vertices[i];
+	if(stamp[w] != epoch) continue;
+	cw = d[v] + adjl.costs[i];
+	if(cw < d[w]) d[w] = cw, pred[w] = i;
+      }
+    }
+  }
+  FOR(h, nt) if(d[touched[h]] < COST_INF) q.push(touched[h]);
+
+  /* the arcs that became cheaper are the other violated ones */
+  FOR(j, m){
+    i = changed[j];
+    if(adjl.costs[i] >= old[j]) continue;
+    v = tails[i];
+    if(d[v] >= COST_INF) continue;
+    w = adjl.adjacent_vertices[i];
+    RELAX(v, i, w);
+  }
+
+  while((v = q.pop()) >= 0)
+    for(i = adjl.n_arcs[v]; i < adjl.n_arcs[v+1]; i++){
+      w = adjl.adjacent_vertices[i];
+      RELAX(v, i, w);
+    }
+
+  return nt;
+}
 
-  //FREE(heap);
-  //FREE(pos);
-  //FREE(d);
+#undef RELAX
+
+int dijkstra_repair ( AdjacentList adjl,
+		      const vertex_t *tails,
+		      InArcs in,
+		      vertex_t u,
+		      const arc_t *changed,
+		      const cost_t *old,
+		      int m,
+		      DijkstraQueue *q,
+		      cost_t *d,
+		      arc_t *pred,
+		      unsigned *stamp,
+		      unsigned epoch,
+		      vertex_t *touched,
+		      arc_t *oldpred )
+{
+  switch(q->kind){
+  case QUEUE_BINARY:
+    return repair(adjl, tails, in, u, changed, old, m, *(DaryHeap<2>*) q->impl, d, pred, stamp, epoch, touched, oldpred);
+  case QUEUE_4ARY:
+    return repair(adjl, tails, in, u, changed, old, m, *(DaryHeap<4>*) q->impl, d, pred, stamp, epoch, touched, oldpred);
+  case QUEUE_RADIX:
+    return repair(adjl, tails, in, u, changed, old, m, *(RadixHeap*) q->impl, d, pred, stamp, epoch, touched, oldpred);
+  case QUEUE_DIAL:
+    return repair(adjl, tails, in, u, changed, old, m, *q->repair, d, pred, stamp, epoch, touched, oldpred);
+  default:
+    return repair(adjl, tails, in, u, changed, old, m, *(SlfLllDeque*) q->impl, d, pred, stamp, epoch, touched, oldpred);
+  }
 }
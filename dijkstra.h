@@ -5,10 +5,22 @@
 extern "C" {
 #endif
 
+/* Width of the vertex, arc and heap indices. They are int by default;
+   compiling with -DDIJKSTRA_SHORT_INDEX selects 16-bit indices, which
+   halves the work arrays but limits networks to 32767 vertices and arcs. */
+#ifdef DIJKSTRA_SHORT_INDEX
 typedef short vertex_t;
 typedef short arc_t;
-typedef float cost_t;
 typedef short index_t;
+#else
+typedef int vertex_t;
+typedef int arc_t;
+typedef int index_t;
+#endif
+typedef float cost_t;
+
+/* distance label of unreachable vertices in repaired trees */
+#define COST_INF 3.0e38f
 
 typedef struct AdjacentList_{
   vertex_t V, *adjacent_vertices;
@@ -18,17 +30,92 @@ typedef struct AdjacentList_{
 
 
 void malloc_adjl(AdjacentList *al);
-void index_adjl(AdjacentList al, arc_t *index);
 void free_adjl(AdjacentList *al);
 
+/* tails[i] is the vertex that adjacency position i leaves */
+vertex_t *build_tails(AdjacentList al);
+void free_tails(vertex_t *tails);
+
+/* arcs entering each vertex: the adjacency positions
+   arcs[first[w] .. first[w+1]) lead to w */
+typedef struct InArcs_{
+  arc_t *first, *arcs;
+} InArcs;
+
+InArcs build_in_arcs(AdjacentList al);
+void free_in_arcs(InArcs *in);
+
+/* Priority queue policies of the search:
+   QUEUE_BINARY, QUEUE_4ARY  binary and 4-ary heaps with decrease-key
+   QUEUE_RADIX               radix heap on the distances scaled to 64-bit
+                             integers (2^40 units per largest arc cost)
+   QUEUE_DIAL                Dial's circular buckets, one per 1/4096 of the
+                             largest arc cost, each a heap on the labels
+   QUEUE_SLF_LLL             label-correcting deque with the small-label-
+                             first and large-label-last rules; it cannot
+                             stop early and always builds the full tree */
+typedef enum {
+  QUEUE_BINARY, QUEUE_4ARY, QUEUE_RADIX, QUEUE_DIAL, QUEUE_SLF_LLL,
+  QUEUE_KINDS
+} queue_kind;
+
+typedef struct DijkstraQueue_ DijkstraQueue;
+
+DijkstraQueue *new_queue(queue_kind kind, vertex_t V);
+void free_queue(DijkstraQueue *q);
+queue_kind queue_type(const DijkstraQueue *q);
+const char *queue_name(queue_kind kind);
+
+/* Must be called when the arc costs change and before the first search:
+   the integer queues scale the distances by the largest arc cost. */
+void scale_queue(DijkstraQueue *q, cost_t maxcost);
+
+/* Shortest path tree from u, stopped once the nv vertices v with vb[v]
+   set have been reached (their marks are cleared as they are reached).
+   pred[v] receives the position in the adjacency list of the tree arc
+   entering v (-1 for u).
+
+   The work arrays are not cleared between searches: a vertex counts as
+   labelled only if stamp[v] == epoch, so every search must use a new
+   epoch. Only labelled vertices have valid d and pred entries. */
 void dijkstra ( AdjacentList adjl,		
 		vertex_t u,
 		char *vb,
 		vertex_t nv,	
-		vertex_t *heap,
-		index_t *pos,
+		DijkstraQueue *q,
 		cost_t *d,
-		vertex_t *trace);
+		arc_t *pred,
+		unsigned *stamp,
+		unsigned epoch);
+
+/* Repairs a full shortest path tree (d, pred) from u after the costs of
+   the arcs at adjacency positions changed[0..m) moved from old[j] to
+   adjl.costs[changed[j]] (Ramalingam and Reps). The subtrees below the
+   tree arcs that became costlier are detached and each of their vertices
+   is seeded with its best arc from the rest of the tree; the arcs that
+   became cheaper are relaxed; the improvements are then propagated with
+   the queue. Only the detached subtrees and the vertices whose label drops
+   are visited, so when every change is a decrease the repair is a search
+   started from the cheaper arcs. Unreachable vertices have d = COST_INF
+   and pred = -1.
+
+   Every vertex whose tree arc may have changed is stamped with epoch (a new
+   one) and listed in touched, with its tree arc before the repair in
+   oldpred; the number of touched vertices is returned. */
+int dijkstra_repair ( AdjacentList adjl,
+		      const vertex_t *tails,
+		      InArcs in,
+		      vertex_t u,
+		      const arc_t *changed,
+		      const cost_t *old,
+		      int m,
+		      DijkstraQueue *q,
+		      cost_t *d,
+		      arc_t *pred,
+		      unsigned *stamp,
+		      unsigned epoch,
+		      vertex_t *touched,
+		      arc_t *oldpred );
 
 #ifdef __cplusplus
 }
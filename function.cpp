@@ -34,6 +34,7 @@ Vector QuarticFunction::g(Vector &v) const{
 	Vector d(v.size());
 	Real x, c, sum;
 	int a;
+	d.enable_position_map(); // scattered coeffRef writes
 
 	FOR(i, v.size()) {
 		sum = 0;
@@ -58,6 +59,7 @@ Vector QuarticFunction::gg(Vector &v) const{
 	Vector d(v.size());
 	Real x, c, sum;
 	int a;
+	d.enable_position_map(); // scattered coeffRef writes
 
 	FOR(i, v.size()) {
 		sum = 0;
@@ -83,56 +85,40 @@ Real BPRFunction::f(Vector &x) const {
 	int K = net.commoflows.size(), A = net.arcs.size();
 	assert(K*A == x.size()); // debug
 	Real sum = 0.0, ya, ca, ta;
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index() / K;
+	ArcCursor<Vector> it(x, K);
+	while(!it.end()){
+		int a = it.arc();
 		ca = net.arcs[a].cap;
 		ta = net.arcs[a].cost;
 		ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
+		do ya += it.value(), it.advance(); while(!it.end() && it.arc() == a);
 		sum += ta*ya*(1 + alpha/(beta+1)*pow(ya/ca,beta));
 	}
 	return sum;
 }
 
-Function* BPRFunction::reduced_function() const {
+ReducedFunction* BPRFunction::reduced_function() const {
 	return new ReducedBPRFunction(net);
 }
 
-Vector BPRFunction::reduced_variable(Vector &x) const {
+DenseArcVector BPRFunction::reduced_variable(Vector &x) const {
 	int K = net.commoflows.size(), A = net.arcs.size();
 	assert(K*A == x.size());
-	Vector y(A);
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index()/K;
-		Real ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
-		y.insert(a) = ya;
-	}
-	return y;
+	return arc_totals(x, A, K);
 }
 
 Vector BPRFunction::g(Vector &x) const {
 	int K = net.commoflows.size(), A = net.arcs.size();
 	assert(K*A == x.size()); // debug
+	DenseArcVector y(arc_totals(x, A, K));
 	Vector d(K*A);
 	Real ya, ca, dd, ta;
-	Vector::iterator itx = x.get_iterator();
-
-	while(!itx.end()){
-		int a = itx.index() / K;
+	for(int a = 0, base = 0; a < A; a++, base += K){
 		ca = net.arcs[a].cap;
 		ta = net.arcs[a].cost;
-		ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
+		ya = y[a];
 		dd = ta + ta*alpha*pow(ya/ca,beta);
-		FOR(k, K) d.insert(a*K+k) = dd;
-
-		int na = itx.end()? A : itx.index()/K;
-		for(int aa = a+1; aa < na; aa++) 
-			FOR(k, K)
-				d.insert(aa*K+k) = net.arcs[aa].cost;		                                                         
+		FOR(k, K) d.insert(base+k) = dd;
 	}
 	return d;
 }
@@ -142,13 +128,13 @@ Vector BPRFunction::gg(Vector &x) const {
 	assert(K*A == x.size()); // debug
 	Vector d(K*A);
 	Real ya, ca, dd, ta;
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index() / K;
+	ArcCursor<Vector> it(x, K);
+	while(!it.end()){
+		int a = it.arc();
 		ca = net.arcs[a].cap;
 		ta = net.arcs[a].cost;
 		ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
+		do ya += it.value(), it.advance(); while(!it.end() && it.arc() == a);
 		dd = ta*alpha*beta*pow(ya/ca,beta-1)/ca;
 		if(fabs(dd)>1e-7) FOR(k, K) d.insert(a*K+k) = dd;
 	}
@@ -158,13 +144,12 @@ Vector BPRFunction::gg(Vector &x) const {
 ReducedBPRFunction::ReducedBPRFunction(const MultiCommoNetwork &n, Real a, Real b): 
 	net(n), alpha(a), beta(b) {}
 
-Real ReducedBPRFunction::f(Vector &x) const {
+Real ReducedBPRFunction::f(const DenseArcVector &y) const {
 	int A = net.arcs.size();
-	assert(A == x.size()); // debug
+	assert(A == y.size()); // debug
 	Real sum = 0.0, ya, ca, ta;
-	ITER(x, itx) {
-		int a = itx.index();
-		ya = itx.value();
+	FOR(a, A) if(y[a] != 0.0){
+		ya = y[a];
 		ca = net.arcs[a].cap;
 		ta = net.arcs[a].cost;
 		sum += ta*ya*(1 + alpha/(beta+1)*pow(ya/ca,beta));
@@ -172,34 +157,29 @@ Real ReducedBPRFunction::f(Vector &x) const {
 	return sum;
 }
 
-Vector ReducedBPRFunction::g(Vector &x) const {
-	int A = net.arcs.size(), a = 0, pa = 0;
-	assert(A == x.size()); // debug
-	Vector d(A);
+DenseArcVector ReducedBPRFunction::g(const DenseArcVector &y) const {
+	int A = net.arcs.size();
+	assert(A == y.size()); // debug
+	DenseArcVector d(A);
 	Real ya, ca, ta;
-	ITER(x, itx){
-		pa = a;
-		a = itx.index();
-		for(int aa = pa+1; aa<a; aa++) d.insert(aa) = net.arcs[aa].cost;
-		ya = itx.value(); 
+	FOR(a, A){
+		ya = y[a]; 
 		ca = net.arcs[a].cap; 
 		ta = net.arcs[a].cost;
-		d.insert(a) = ta + ta*alpha*pow(ya/ca,beta);
+		d[a] = ya != 0.0 ? ta + ta*alpha*pow(ya/ca,beta) : ta;
 	}
-	for(int aa = a+1; aa<A; aa++) d.insert(aa) = net.arcs[aa].cost;
 	return d;
 }
 
-Vector ReducedBPRFunction::gg(Vector &x) const {
+DenseArcVector ReducedBPRFunction::gg(const DenseArcVector &y) const {
 	int A = net.arcs.size();
-	assert(A == x.size()); // debug
-	Vector d(A);
+	assert(A == y.size()); // debug
+	DenseArcVector d(A);
 	Real ya, ca, ta;
-	ITER(x, itx) {
-		int a = itx.index();
-		ya = itx.value(); ca = net.arcs[a].cap; ta = net.arcs[a].cost;
+	FOR(a, A) if(y[a] != 0.0){
+		ya = y[a]; ca = net.arcs[a].cap; ta = net.arcs[a].cost;
 		assert(ca>0.0);
-		d.insert(a) = ta*alpha*beta*pow(ya/ca,beta-1)/ca;
+		d[a] = ta*alpha*beta*pow(ya/ca,beta-1)/ca;
 	}
 	return d;
 }
@@ -208,12 +188,12 @@ Real KleinrockFunction::f(Vector &x) const{
 	int K = net.commoflows.size(), A = net.arcs.size();
 	assert(K*A == x.size()); // debug
 	Real sum = 0.0, ya, ca;
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index() / K;
+	ArcCursor<Vector> it(x, K);
+	while(!it.end()){
+		int a = it.arc();
 		ca = net.arcs[a].cap;
 		ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
+		do ya += it.value(), it.advance(); while(!it.end() && it.arc() == a);
 		if(ca>ya) sum += ya/(ca-ya);
 		else return INFINITY;
 	}
@@ -225,12 +205,12 @@ Vector KleinrockFunction::g(Vector &x) const{
 	assert(K*A == x.size()); // debug
 	Vector d(K*A);
 	Real ya, ca, dd;
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index() / K;
+	ArcCursor<Vector> it(x, K);
+	while(!it.end()){
+		int a = it.arc();
 		ca = net.arcs[a].cap;
 		ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
+		do ya += it.value(), it.advance(); while(!it.end() && it.arc() == a);
 		dd = ca - ya;
 		if(dd > 0) dd = ca/(dd*dd);
 		else dd = INFINITY;
@@ -239,22 +219,14 @@ Vector KleinrockFunction::g(Vector &x) const{
 	return d;
 }
 
-Function* KleinrockFunction::reduced_function() const {
+ReducedFunction* KleinrockFunction::reduced_function() const {
 	return new ReducedKleinrockFunction(net);
 }
 
-Vector KleinrockFunction::reduced_variable(Vector &x) const {
+DenseArcVector KleinrockFunction::reduced_variable(Vector &x) const {
 	int K = net.commoflows.size(), A = net.arcs.size();
 	assert(K*A == x.size());
-	Vector y (A);
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index()/K;
-		Real ya = 0.0;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K == a);
-		y.insert(a) = ya;
-	}
-	return y;
+	return arc_totals(x, A, K);
 }
 
 Vector KleinrockFunction::gg(Vector &x) const{
@@ -262,11 +234,11 @@ Vector KleinrockFunction::gg(Vector &x) const{
 	assert(K*A == x.size()); // debug
 	Vector d(K*A);
 	Real ya, ca, dd;
-	Vector::iterator itx = x.get_iterator();
-	while(!itx.end()){
-		int a = itx.index()/K;
+	ArcCursor<Vector> it(x, K);
+	while(!it.end()){
+		int a = it.arc();
 		ya = 0.0; ca = net.arcs[a].cap;
-		do ya += itx.value(), ++itx; while(!itx.end() && itx.index()/K==a);
+		do ya += it.value(), it.advance(); while(!it.end() && it.arc() == a);
 		dd = ca - ya;
 		//assert(ca-ya>0);
 		if(ca-ya>0) dd = 2*ca/(dd*dd*dd);
@@ -280,13 +252,12 @@ KleinrockFunction::KleinrockFunction(const MultiCommoNetwork &n) : net(n){
 }
 
 
-Real ReducedKleinrockFunction::f(Vector &x) const {
+Real ReducedKleinrockFunction::f(const DenseArcVector &y) const {
 	int A = net.arcs.size();
-	assert(A == x.size()); // debug
+	assert(A == y.size()); // debug
 	Real sum = 0.0, ya, ca;
-	ITER(x, itx){
-		int a = itx.index();
-		ya = itx.value();
+	FOR(a, A){
+		ya = y[a];
 		ca = net.arcs[a].cap;
 		//assert(ca-ya>0);
 		if(ca>ya) sum += ya/(ca-ya); else return INFINITY;
@@ -294,36 +265,34 @@ Real ReducedKleinrockFunction::f(Vector &x) const {
 	return sum;
 }
 
-Vector ReducedKleinrockFunction::g(Vector &x) const{
+DenseArcVector ReducedKleinrockFunction::g(const DenseArcVector &y) const{
 	int A = net.arcs.size();
-	assert(A == x.size()); // debug
-	Vector d(A);
+	assert(A == y.size()); // debug
+	DenseArcVector d(A);
 	Real ya, ca, dd;
-	ITER(x, itx){
-		int a = itx.index();
-		ya = itx.value(); ca = net.arcs[a].cap;
+	FOR(a, A){
+		ya = y[a]; ca = net.arcs[a].cap;
 		//assert(ca-ya>0);
 		dd = ca - ya;
 		if(dd>0) dd = ca/(dd*dd);
 		else dd = INFINITY;
-		d.insert(a) = dd;
+		d[a] = dd;
 	}
 	return d;
 }
 
-Vector ReducedKleinrockFunction::gg(Vector &x) const{
+DenseArcVector ReducedKleinrockFunction::gg(const DenseArcVector &y) const{
 	int A = net.arcs.size();
-	assert(A == x.size()); // debug
-	Vector d(A);
+	assert(A == y.size()); // debug
+	DenseArcVector d(A);
 	Real ya, ca, dd;
-	ITER(x, itx){
-		int a = itx.index();
-		ya = itx.value(); ca = net.arcs[a].cap;
+	FOR(a, A){
+		ya = y[a]; ca = net.arcs[a].cap;
 		//assert(ca-ya>0);
 		dd = ca - ya;
 		if(dd>0) dd = 2*ca/(dd*dd*dd);
 		else dd = INFINITY;
-		d.insert(a) = dd;
+		d[a] = dd;
 	}
 	return d;
 }
@@ -334,16 +303,39 @@ ReducedKleinrockFunction::ReducedKleinrockFunction(const MultiCommoNetwork &n) :
 
 #define PHI 0.6180339887498948482045868343656
 
-Real golden_section_search ( Vector &A,
-                             Vector &B,
-                             Function *obj,
+// The section searches below run both on flow vectors (Vector, Function)
+// and on reduced variables (DenseArcVector, ReducedFunction); the two
+// helpers hide the different ways the vector types combine
+
+// x = a + b - c
+static inline void reflect(Vector &x, Vector &a, Vector &b, Vector &c){
+	x = a + b - c;
+}
+
+static inline void reflect(DenseArcVector &x, DenseArcVector &a, DenseArcVector &b, DenseArcVector &c){
+	x.combine(1.0, a, 1.0, b, -1.0, c);
+}
+
+// x = a + t*(x - b)
+static inline void step_back(Vector &x, Vector &a, Vector &b, Real t){
+	x = a + t*(x - b);
+}
+
+static inline void step_back(DenseArcVector &x, DenseArcVector &a, DenseArcVector &b, Real t){
+	x.combine(1.0, a, t, x, -t, b);
+}
+
+template <class V, class F>
+Real golden_section_search ( V &A,
+                             V &B,
+                             F *obj,
                              int iterations)
 {
-	Vector *x1 = new Vector(A), *x4 = new Vector(B);
-	Vector *x2 = new Vector(B), *x3 = new Vector(B), *xtmp;
+	V v1(A), v2(B.size()), v3(B.size()), v4(B);
+	V *x1 = &v1, *x2 = &v2, *x3 = &v3, *x4 = &v4, *xtmp;
   
-	(*x2) -= A; (*x2) *= (1-PHI); (*x2) += A;
-	(*x3) += A; (*x3) -= (*x2);
+	x2->lerp(A, B, 1-PHI);
+	x3->lerp(A, B, PHI);
 
 	Real f1 = obj->f(A), f4 = obj->f(B);
 	Real f2 = obj->f(*x2), f3 = obj->f(*x3), fm = f1;
@@ -359,7 +351,7 @@ Real golden_section_search ( Vector &A,
 			f1 = f2; f2 = f3;
 			b1 = b2; b2 = b3;
 
-			(*x3) = (*x1); (*x3) += (*x4); (*x3) -= (*x2);
+			reflect(*x3, *x1, *x4, *x2);
 			f3 = obj->f(*x3);
 			b3 = b1 + b4 - b2;      
 
@@ -370,7 +362,7 @@ Real golden_section_search ( Vector &A,
 			f4 = f3; f3 = f2;
 			b4 = b3; b3 = b2;
 
-			(*x2) = (*x1); (*x2) += (*x4); (*x2) -= (*x3);
+			reflect(*x2, *x1, *x4, *x3);
 			f2 = obj->f(*x2);
 			b2 = b1 + b4 - b3;
 
@@ -378,24 +370,24 @@ Real golden_section_search ( Vector &A,
 		}
 	}
 
-	delete x1; delete x2; delete x3; delete x4;
 	return bm;
 }
 
 extern fstream iteration_report;
 
-Real general_section_search ( Vector &A,
-                              Vector &B,
-                              Function *obj,
+template <class V, class F>
+Real general_section_search ( V &A,
+                              V &B,
+                              F *obj,
                               int iterations,
                               Real b2, Real b3)
 {
 	//iteration_report << "general section search" << endl;
-	Vector *x1 = new Vector(A), *x4 = new Vector(B);
-	Vector *x2 = new Vector(B), *x3 = new Vector(B), *xtmp;
+	V v1(A), v2(B.size()), v3(B.size()), v4(B);
+	V *x1 = &v1, *x2 = &v2, *x3 = &v3, *x4 = &v4, *xtmp;
   
-	(*x2) -= A; (*x2) *= b2; (*x2) += A;
-	(*x3) -= A; (*x3) *= b3; (*x3) += A;
+	x2->lerp(A, B, b2);
+	x3->lerp(A, B, b3);
 
 	Real f1 = obj->f(A), f4 = obj->f(B);
 	Real f2 = obj->f(*x2), f3 = obj->f(*x3), fm = f1;
@@ -417,7 +409,7 @@ Real general_section_search ( Vector &A,
 		// safe guard the case where x2 and x3 are too close to each other
 		if(fabs(b2-b3)<1e-12 && fabs(f2-f3) < 1e-6){
 			iteration_report << "x2 and x3 too close at iteration "<<i<<endl;
-			(*x3) -= (*x4); (*x3) *= (PHI-1); (*x3) += (*x2);
+			step_back(*x3, *x2, *x4, PHI-1);
 			f3 = obj->f(*x3);
 			b3 -= b4; b3 *= (PHI-1); b3 += b2;
 			if(fm > f3) fm = f3, bm = b3;
@@ -431,7 +423,7 @@ Real general_section_search ( Vector &A,
 			f1 = f2; f2 = f3;
 			b1 = b2; b2 = b3;
 
-			(*x3) = (*x1); (*x3) += (*x4); (*x3) -= (*x2);
+			reflect(*x3, *x1, *x4, *x2);
 			f3 = obj->f(*x3);
 			b3 = b1 + b4 - b2;      
 
@@ -445,7 +437,7 @@ Real general_section_search ( Vector &A,
 			f4 = f3; f3 = f2;
 			b4 = b3; b3 = b2;
 
-			(*x2) = (*x1); (*x2) += (*x4); (*x2) -= (*x3);
+			reflect(*x2, *x1, *x4, *x3);
 			f2 = obj->f(*x2);
 			b2 = b1 + b4 - b3;
 
@@ -454,7 +446,6 @@ Real general_section_search ( Vector &A,
 		if(fabs(fbound-fm)/(fbound+fm) < 0.5*1e-9) break;
 	}  
 
-	delete x1; delete x2; delete x3; delete x4;
 	return bm;
 }
 
@@ -474,9 +465,9 @@ Real section_search ( Vector &A,
 	if(casted_obj != NULL){
 		// If it can be casted --> it is a reducable function
 		// then do the search with the reduced function and variables instead
-		Function* reduced_obj = casted_obj->reduced_function();
-		Vector A_ = casted_obj->reduced_variable(A);
-		Vector B_ = casted_obj->reduced_variable(B);
+		ReducedFunction* reduced_obj = casted_obj->reduced_function();
+		DenseArcVector A_ = casted_obj->reduced_variable(A);
+		DenseArcVector B_ = casted_obj->reduced_variable(B);
 		Real lambda = section_search( A_, B_,
 		                              reduced_obj,
 		                              iterations,
@@ -490,11 +481,22 @@ Real section_search ( Vector &A,
 	return general_section_search (A,B,obj,iterations,b1,b2);
 }
 
+Real section_search ( DenseArcVector &A, 
+                      DenseArcVector &B, 
+                      ReducedFunction *obj, 
+                      int iterations,
+                      bool to_use_golden_ratio,
+                      Real b1, Real b2)
+{
+	if(to_use_golden_ratio) return golden_section_search(A,B,obj,iterations);
+	return general_section_search (A,B,obj,iterations,b1,b2);
+}
+
 // Naive line search between A and B
 Real line_search (Vector &A, Vector &B, Function *obj, int niteration){
 	Vector x(A), dx(B);
 	Real fmin = obj->f(x), imin = 0.0, f;
-	dx -= A; dx *= (1.0/niteration);
+	dx.axpby(-1.0/niteration, A, 1.0/niteration, B);
 	FOR(i, niteration){
 		x += dx;
 		f = obj->f(x);
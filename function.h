@@ -2,6 +2,7 @@
 #define __FUNCTION_H__
 
 #include "network.h"
+#include "arc_cursor.h"
 
 #define PHI 0.6180339887498948482045868343656
 
@@ -23,10 +24,20 @@ class Function{
 	virtual ~Function() {} ;
 };
 
+// Prototype of a function of the total flows on the arcs (the reduced
+// variable of a ReducableFunction), which is dense over the arcs
+class ReducedFunction{
+ public:
+	virtual Real f(const DenseArcVector &y) const = 0;
+	virtual DenseArcVector g(const DenseArcVector &y) const = 0;
+	virtual DenseArcVector gg(const DenseArcVector &y) const = 0;
+	virtual ~ReducedFunction() {} ;
+};
+
 class ReducableFunction : public Function {
  public:
-	virtual Function* reduced_function() const = 0;
-	virtual Vector reduced_variable(Vector &) const = 0;
+	virtual ReducedFunction* reduced_function() const = 0;
+	virtual DenseArcVector reduced_variable(Vector &) const = 0;
 };
 
 // quartic function with delay propagation
@@ -59,19 +70,19 @@ class BPRFunction: public ReducableFunction {
 		return net;
 	}
   
-	virtual Function* reduced_function() const;
-	virtual Vector reduced_variable(Vector &) const;
+	virtual ReducedFunction* reduced_function() const;
+	virtual DenseArcVector reduced_variable(Vector &) const;
 };
 
-class ReducedBPRFunction: public Function {
+class ReducedBPRFunction: public ReducedFunction {
  private:
 	MultiCommoNetwork net;
 	Real alpha, beta;
 	
  public:
-	virtual Real f(Vector &x) const;
-	virtual Vector g(Vector &x) const;
-	virtual Vector gg(Vector &x) const;
+	virtual Real f(const DenseArcVector &y) const;
+	virtual DenseArcVector g(const DenseArcVector &y) const;
+	virtual DenseArcVector gg(const DenseArcVector &y) const;
 	ReducedBPRFunction(const MultiCommoNetwork &n, const Real a=0.15, Real b=4);
 };
 
@@ -85,19 +96,19 @@ class KleinrockFunction : public ReducableFunction {
 	virtual Vector gg(Vector &x) const;
 	KleinrockFunction(const MultiCommoNetwork &n);  
 
-	virtual Function* reduced_function() const;
-	virtual Vector reduced_variable(Vector &) const;
+	virtual ReducedFunction* reduced_function() const;
+	virtual DenseArcVector reduced_variable(Vector &) const;
 };
 
 
-class ReducedKleinrockFunction : public Function {
+class ReducedKleinrockFunction : public ReducedFunction {
  private:
 	MultiCommoNetwork net;
 
  public:
-	virtual Real f(Vector &x) const;
-	virtual Vector g(Vector &x) const;
-	virtual Vector gg(Vector &x) const;
+	virtual Real f(const DenseArcVector &y) const;
+	virtual DenseArcVector g(const DenseArcVector &y) const;
+	virtual DenseArcVector gg(const DenseArcVector &y) const;
 	ReducedKleinrockFunction(const MultiCommoNetwork &n);  
 };
 
@@ -109,6 +120,14 @@ Real section_search ( Vector &x0,
                       Real b1 = 1-PHI, 
                       Real b2 = PHI);
 
+Real section_search ( DenseArcVector &y0, 
+                      DenseArcVector &y1, 
+                      ReducedFunction *obj, 
+                      int iterations = 20,
+                      bool to_use_golden_ratio = true,
+                      Real b1 = 1-PHI, 
+                      Real b2 = PHI);
+
 Real line_search (Vector &x0, Vector &x1, Function *obj, int niteration = 20);
 
 #endif
@@ -57,6 +57,15 @@ int main(int argc, char* argv[]){
     format = TNTP;
   
   MultiCommoNetwork net(inputname.c_str(), format);
+
+  // vertex order for locality of the shortest path labels
+  string order = settings.gets("vertex order");
+  if(order != "file"){
+    double before = net.label_span();
+    net.renumber(order);
+    iteration_report << "Renumbering (" << order << "): mean label span of the arcs "
+                     << before << " -> " << net.label_span() << endl << endl;
+  }
   timer->record();
   
   cout << "Modelling" << endl;
@@ -0,0 +1,190 @@
+#ifndef __MY_SPARSE_EXPR__
+#define __MY_SPARSE_EXPR__
+
+// Lazy arithmetic for MySparseVector (expression templates).
+//
+// x + y, x - y, a*x and any nesting of them build a small expression object
+// instead of a temporary vector. The expression is evaluated when it is
+// assigned to (or used to construct, +=, -=) a MySparseVector, or passed to
+// dot(): every node then acts as a cursor over the sorted supports of its
+// operands, and the whole expression is consumed in one merge pass.
+//
+// Expressions hold pointers into the operands' arrays, so they must be
+// evaluated within the full-expression that creates them.
+
+#include <climits>
+#include <cmath>
+#include <cassert>
+
+// Cursor over the sorted nonzeros of a MySparseVector
+class SparseTerm : public SparseExpr<SparseTerm> {
+	const int *pi, *pend;
+	const double *pv;
+	int n;
+
+ public:
+	SparseTerm(const MySparseVector &v) : n(v.size()) {
+		v.sort();
+		int nz = v.nonZeros();
+		pi = nz ? &v.idx[0] : NULL;
+		pend = pi + nz;
+		pv = nz ? &v.val[0] : NULL;
+	}
+
+	inline bool end() const { return pi == pend; }
+	inline int index() const { return pi == pend ? INT_MAX : *pi; }
+	inline double value() const { return *pv; }
+	inline void step(int i) { if(pi != pend && *pi == i) ++pi, ++pv; }
+	inline void advance() { ++pi; ++pv; }
+	inline int size() const { return n; }
+	inline int capacity() const { return pend - pi; }
+};
+
+// Maps an operand type to the node type stored inside an expression:
+// vectors are stored as cursors, sub-expressions by value
+template <class E> struct SparseNode { typedef E type; };
+template <> struct SparseNode<MySparseVector> { typedef SparseTerm type; };
+
+// Cursor protocol shared by the nodes below: index() is the smallest index
+// not yet consumed (INT_MAX at the end), value() the value at that index and
+// step(i) consumes index i in every operand positioned on it.
+template <class L, class R, int SIGN>
+class SparseSum : public SparseExpr< SparseSum<L, R, SIGN> > {
+	typename SparseNode<L>::type l;
+	typename SparseNode<R>::type r;
+
+ public:
+	SparseSum(const L &l_, const R &r_) : l(l_), r(r_) {
+		assert(l.size() == r.size());
+	}
+
+	inline int index() const {
+		int i = l.index(), j = r.index();
+		return i < j ? i : j;
+	}
+	inline bool end() const { return index() == INT_MAX; }
+	inline double value() const {
+		int i = index();
+		double v = 0.0;
+		if(l.index() == i) v += l.value();
+		if(r.index() == i) v += SIGN*r.value();
+		return v;
+	}
+	inline void step(int i) { l.step(i); r.step(i); }
+	inline void advance() { step(index()); }
+	inline int size() const { return l.size(); }
+	inline int capacity() const { return l.capacity() + r.capacity(); }
+};
+
+template <class E>
+class SparseScaled : public SparseExpr< SparseScaled<E> > {
+	double alpha;
+	typename SparseNode<E>::type e;
+
+ public:
+	SparseScaled(double a, const E &e_) : alpha(a), e(e_) {}
+
+	inline int index() const { return e.index(); }
+	inline bool end() const { return e.index() == INT_MAX; }
+	inline double value() const { return alpha*e.value(); }
+	inline void step(int i) { e.step(i); }
+	inline void advance() { step(index()); }
+	inline int size() const { return e.size(); }
+	inline int capacity() const { return e.capacity(); }
+};
+
+template <class L, class R>
+inline SparseSum<L, R, 1> operator + (const SparseExpr<L> &l, const SparseExpr<R> &r){
+	return SparseSum<L, R, 1>(l.derived(), r.derived());
+}
+
+template <class L, class R>
+inline SparseSum<L, R, -1> operator - (const SparseExpr<L> &l, const SparseExpr<R> &r){
+	return SparseSum<L, R, -1>(l.derived(), r.derived());
+}
+
+template <class E>
+inline SparseScaled<E> operator * (double a, const SparseExpr<E> &e){
+	return SparseScaled<E>(a, e.derived());
+}
+
+template <class E>
+inline SparseScaled<E> operator * (const SparseExpr<E> &e, double a){
+	return SparseScaled<E>(a, e.derived());
+}
+
+template <class E>
+inline SparseScaled<E> operator - (const SparseExpr<E> &e){
+	return SparseScaled<E>(-1.0, e.derived());
+}
+
+// inner product of two expressions, in a single pass over both
+template <class L, class R>
+double dot(const SparseExpr<L> &l_, const SparseExpr<R> &r_){
+	typename SparseNode<L>::type l(l_.derived());
+	typename SparseNode<R>::type r(r_.derived());
+	assert(l.size() == r.size());
+	double sum = 0.0;
+	for(int i = l.index(), j = r.index(); i != INT_MAX && j != INT_MAX; ){
+		if(i == j){
+			sum += l.value()*r.value();
+			l.step(i); r.step(j);
+			i = l.index(); j = r.index();
+		}
+		else if(i < j) l.step(i), i = l.index();
+		else r.step(j), j = r.index();
+	}
+	return sum;
+}
+
+template <class E>
+void MySparseVector::assign(const SparseExpr<E> &e_){
+	typename SparseNode<E>::type e(e_.derived());
+	vector<int> ridx;
+	vector<double> rval;
+	SparseBufferPool::acquire(ridx, rval, e.capacity());
+
+	for(int i = e.index(); i != INT_MAX; e.step(i), i = e.index()){
+		double v = e.value();
+		if(fabs(v) >= 1e-10) ridx.push_back(i), rval.push_back(v);
+	}
+
+	// the operands may alias this vector: swap in the result only at the end
+	size_ = e.size();
+	idx.swap(ridx);
+	val.swap(rval);
+	sorted = true;
+	pos_valid = false;
+	SparseBufferPool::release(ridx, rval);
+}
+
+template <class E>
+MySparseVector::MySparseVector(const SparseExpr<E> &e) :
+	idx(), val(), sorted(true), size_(0), use_pos(false), pos_valid(false), pos() {
+	assign(e);
+}
+
+template <class E>
+MySparseVector& MySparseVector::operator = (const SparseExpr<E> &e){
+	assign(e);
+	return *this;
+}
+
+template <class E>
+MySparseVector& MySparseVector::operator += (const SparseExpr<E> &e){
+	assign(*this + e);
+	return *this;
+}
+
+template <class E>
+MySparseVector& MySparseVector::operator -= (const SparseExpr<E> &e){
+	assign(*this - e);
+	return *this;
+}
+
+template <class E>
+double MySparseVector::dot(const SparseExpr<E> &e){
+	return ::dot(*this, e);
+}
+
+#endif
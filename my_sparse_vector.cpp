@@ -1,182 +1,671 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <climits>
+#include <cstring>
 #include "my_sparse_vector.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the AVX2 intersection kernel is compiled with a target attribute and
+// selected at run time, so the binary still runs on CPUs without AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
 
 inline double sqr(double a){
 	return a*a;
 }
 
-MySparseVector::iterator MySparseVector::get_iterator(){
+SparseBufferPool *SparseBufferPool::active = NULL;
+
+SparseBufferPool::SparseBufferPool() :
+	previous(active), buffers(), epoch(0), hits(0), misses(0) {
+	buffers.reserve(MAX_BUFFERS); // Buffer slots are never reallocated
+	active = this;
+}
+
+SparseBufferPool::~SparseBufferPool(){
+	active = previous;
+}
+
+void SparseBufferPool::reset(){
+	for(int i = 0; i < int(buffers.size()); )
+		if(buffers[i].epoch < epoch){
+			buffers[i].idx.swap(buffers.back().idx);
+			buffers[i].val.swap(buffers.back().val);
+			buffers[i].epoch = buffers.back().epoch;
+			buffers.pop_back();
+		}
+		else i++;
+	epoch++;
+}
+
+void SparseBufferPool::acquire(vector<int> &idx, vector<double> &val, int n){
+	assert(idx.empty() && val.empty());
+	SparseBufferPool *pool = active;
+	int best = -1;
+	if(pool != NULL)
+		for(int i = 0, m = pool->buffers.size(); i < m; i++)
+			if(int(pool->buffers[i].idx.capacity()) >= n &&
+			   (best < 0 || pool->buffers[i].idx.capacity() < pool->buffers[best].idx.capacity()))
+				best = i;
+
+	if(best < 0){
+		if(pool != NULL) pool->misses++;
+		idx.reserve(n);
+		val.reserve(n);
+		return;
+	}
+
+	pool->hits++;
+	vector<Buffer> &b = pool->buffers;
+	idx.swap(b[best].idx);
+	val.swap(b[best].val);
+	b[best].idx.swap(b.back().idx);
+	b[best].val.swap(b.back().val);
+	b[best].epoch = b.back().epoch;
+	b.pop_back();
+}
+
+void SparseBufferPool::release(vector<int> &idx, vector<double> &val){
+	SparseBufferPool *pool = active;
+	if(pool == NULL || idx.capacity() == 0 || int(pool->buffers.size()) == MAX_BUFFERS){
+		vector<int>().swap(idx);
+		vector<double>().swap(val);
+		return;
+	}
+
+	idx.clear();
+	val.clear();
+	pool->buffers.resize(pool->buffers.size() + 1);
+	pool->buffers.back().idx.swap(idx);
+	pool->buffers.back().val.swap(val);
+	pool->buffers.back().epoch = pool->epoch;
+}
+
+MySparseVector::iterator::iterator(const MySparseVector *v_){
+	int n = v_->idx.size();
+	pi = n ? &v_->idx[0] : NULL;
+	pend = pi + n;
+	pv = n ? &v_->val[0] : NULL;
+}
+
+MySparseVector::iterator MySparseVector::get_iterator() const{
 	sort();
 	return iterator(this);
 }
 
-void MySparseVector::sort(){
-	if(!sorted) val.sort();
-  sorted = true;
+// Sort the (index, value) arrays by index; duplicated indices coming from
+// out-of-order inserts are combined into a single entry.
+void MySparseVector::sort() const{
+	if(sorted) return;
+	sorted = true;
+	pos_valid = false;
+
+	int n = idx.size();
+	vector< pair<int, double> > tmp(n);
+	for(int i = 0; i < n; i++) tmp[i] = make_pair(idx[i], val[i]);
+	std::sort(tmp.begin(), tmp.end());
+
+	int m = 0;
+	for(int i = 0; i < n; i++)
+		if(m > 0 && idx[m-1] == tmp[i].first) val[m-1] += tmp[i].second;
+		else idx[m] = tmp[i].first, val[m] = tmp[i].second, m++;
+	idx.resize(m);
+	val.resize(m);
+}
+
+MySparseVector::MySparseVector(int n) :
+	idx(), val(), sorted(true), size_(n), use_pos(false), pos_valid(false), pos() {
+}
+
+MySparseVector::MySparseVector(const MySparseVector &x) :
+	idx(), val(), sorted(x.sorted), size_(x.size_),
+	use_pos(x.use_pos), pos_valid(x.pos_valid), pos(x.pos) {
+	SparseBufferPool::acquire(idx, val, x.idx.size());
+	idx.insert(idx.end(), x.idx.begin(), x.idx.end());
+	val.insert(val.end(), x.val.begin(), x.val.end());
+}
+
+MySparseVector& MySparseVector::operator = (const MySparseVector &x){
+	if(this == &x) return *this;
+	if(idx.capacity() < x.idx.size()){
+		SparseBufferPool::release(idx, val);
+		SparseBufferPool::acquire(idx, val, x.idx.size());
+	}
+	idx.assign(x.idx.begin(), x.idx.end());
+	val.assign(x.val.begin(), x.val.end());
+	sorted = x.sorted;
+	size_ = x.size_;
+	use_pos = x.use_pos;
+	pos_valid = x.pos_valid;
+	pos = x.pos;
+	return *this;
+}
+
+MySparseVector::~MySparseVector(){
+	SparseBufferPool::release(idx, val);
+}
+
+void MySparseVector::swap(MySparseVector &x){
+	idx.swap(x.idx);
+	val.swap(x.val);
+	pos.swap(x.pos);
+	std::swap(sorted, x.sorted);
+	std::swap(size_, x.size_);
+	std::swap(use_pos, x.use_pos);
+	std::swap(pos_valid, x.pos_valid);
+}
+
+#if __cplusplus >= 201103L
+MySparseVector::MySparseVector(MySparseVector &&x) :
+	idx(), val(), sorted(true), size_(x.size_), use_pos(false), pos_valid(false), pos() {
+	swap(x);
+}
+
+MySparseVector& MySparseVector::operator = (MySparseVector &&x){
+	if(this == &x) return *this;
+	int n = x.size_;
+	swap(x);
+	x.idx.clear();
+	x.val.clear();
+	x.sorted = true;
+	x.size_ = n;
+	x.use_pos = false;
+	x.pos_valid = false;
+	vector<int>().swap(x.pos);
+	return *this;
+}
+#endif
+
+// Merges switch to the in-place/galloping kernels when one operand has at
+// least SKEW times fewer nonzeros than the other
+static const int SKEW = 16;
+
+// First position p in [lo, n) with a[p] >= key (n if none). The search
+// probes lo+1, lo+2, lo+4, ... before bisecting, so its cost is logarithmic
+// in the distance p - lo rather than in n.
+static inline int gallop(const int *a, int lo, int n, int key){
+	if(lo >= n || a[lo] >= key) return lo;
+	int step = 1, hi = lo + 1;
+	while(hi < n && a[hi] < key) lo = hi, step <<= 1, hi = lo + step;
+	if(hi > n) hi = n;
+	return lower_bound(a + lo + 1, a + hi, key) - a;
+}
+
+// Partitioned operations: the index range [0, size) is cut into PAR_CHUNKS
+// chunks of chunk_length indices each. The chunks depend only on the size
+// of the vectors, never on the number of threads.
+static const int PAR_CHUNKS = 64;
+
+int MySparseVector::par_threshold = 0;
+int MySparseVector::par_grain = 1;
+
+void MySparseVector::set_parallel(int threshold, int grain){
+	par_threshold = threshold;
+	par_grain = grain > 0 ? grain : 1;
+}
+
+// length of the chunks of [0, n): a multiple of grain
+static inline int chunk_length(int n, int grain){
+	int len = (n + PAR_CHUNKS - 1) / PAR_CHUNKS;
+	return max(grain, (len + grain - 1) / grain * grain);
+}
+
+// positions [lo, hi) of the entries of the sorted idx[0..n) that fall into
+// chunk c of length len
+static inline void chunk_range(const int *idx, int n, int len, int c, int &lo, int &hi){
+	long long first = (long long) c * len, last = first + len;
+	int f = first < INT_MAX ? int(first) : INT_MAX, l = last < INT_MAX ? int(last) : INT_MAX;
+	lo = lower_bound(idx, idx + n, f) - idx;
+	hi = lower_bound(idx + lo, idx + n, l) - idx;
+}
+
+// Merge kernel of MySparseVector::merge on raw arrays: writes the entries
+// of sa*s + ba*b to oi/ov and returns their number. With WRITE = false it
+// only counts them.
+template <bool WRITE>
+static int merge_kernel(const int *si, const double *sv, int ns, double sa,
+                        const int *bi, const double *bv, int nb, double ba,
+                        int *oi, double *ov){
+	int i = 0, k = 0;
+	for(int j = 0; j < ns; j++){
+		int p = gallop(bi, i, nb, si[j]);
+		if(WRITE) for(; i < p; i++, k++) oi[k] = bi[i], ov[k] = ba*bv[i];
+		else k += p - i, i = p;
+		if(i < nb && bi[i] == si[j]){
+			double v = ba*bv[i] + sa*sv[j];
+			if(fabs(v) >= 1e-10){
+				if(WRITE) oi[k] = si[j], ov[k] = v;
+				k++;
+			}
+			i++;
+		}
+		else{
+			if(WRITE) oi[k] = si[j], ov[k] = sa*sv[j];
+			k++;
+		}
+	}
+	if(WRITE) for(; i < nb; i++, k++) oi[k] = bi[i], ov[k] = ba*bv[i];
+	else k += nb - i;
+	return k;
+}
+
+struct MergeJob {
+	const int *si, *bi;
+	const double *sv, *bv;
+	int ns, nb, len;
+	double sa, ba;
+	vector<int> count; // entries written by each chunk
+	vector<int> start; // first output position of each chunk
+	int *oi;           // output; NULL in the counting pass
+	double *ov;
+};
+
+static void merge_chunk(int c, void *arg){
+	MergeJob &m = *(MergeJob*) arg;
+	int s0, s1, b0, b1;
+	chunk_range(m.si, m.ns, m.len, c, s0, s1);
+	chunk_range(m.bi, m.nb, m.len, c, b0, b1);
+	if(m.oi == NULL)
+		m.count[c] = merge_kernel<false>(m.si + s0, m.sv + s0, s1 - s0, m.sa,
+		                                 m.bi + b0, m.bv + b0, b1 - b0, m.ba, NULL, NULL);
+	else
+		merge_kernel<true>(m.si + s0, m.sv + s0, s1 - s0, m.sa,
+		                   m.bi + b0, m.bv + b0, b1 - b0, m.ba,
+		                   m.oi + m.start[c], m.ov + m.start[c]);
+}
+
+// ridx/rval = sa*s + ba*b over the chunks in parallel: one pass counts the
+// output of every chunk, the next writes each chunk at its offset
+static void merge_partitioned(const int *si, const double *sv, int ns, double sa,
+                              const int *bi, const double *bv, int nb, double ba,
+                              int size, int grain, vector<int> &ridx, vector<double> &rval){
+	MergeJob m;
+	m.si = si; m.sv = sv; m.ns = ns; m.sa = sa;
+	m.bi = bi; m.bv = bv; m.nb = nb; m.ba = ba;
+	m.len = chunk_length(size, grain);
+	m.count.resize(PAR_CHUNKS);
+	m.start.resize(PAR_CHUNKS);
+	m.oi = NULL;
+	m.ov = NULL;
+	ThreadPool::run(PAR_CHUNKS, merge_chunk, &m);
+
+	int total = 0;
+	for(int c = 0; c < PAR_CHUNKS; c++) m.start[c] = total, total += m.count[c];
+	SparseBufferPool::acquire(ridx, rval, total);
+	ridx.resize(total);
+	rval.resize(total);
+	if(total == 0) return;
+	m.oi = &ridx[0];
+	m.ov = &rval[0];
+	ThreadPool::run(PAR_CHUNKS, merge_chunk, &m);
+}
+
+void MySparseVector::merge(double a, MySparseVector &x, double b, MySparseVector &y){
+	assert(x.size_ == y.size_);
+	x.sort(); y.sort();
+
+	// a zero coefficient drops the whole operand (e.g. lerp with t = 0 or 1)
+	int nx = (a == 0.0) ? 0 : x.idx.size(), ny = (b == 0.0) ? 0 : y.idx.size();
+
+	// a few entries added to a much larger vector: update it in place
+	if(&x == this && &y != this && a == 1.0 && ny > 0 && ny*SKEW <= nx){
+		update_sparse(b, y);
+		return;
+	}
+	if(&y == this && &x != this && b == 1.0 && nx > 0 && nx*SKEW <= ny){
+		update_sparse(a, x);
+		return;
+	}
+
+	// The smaller operand drives the merge; the runs of the larger one
+	// between two of its indices are located by galloping and copied as
+	// blocks, so a skewed merge costs O(ns log(nb/ns)) comparisons.
+	bool xsmall = nx <= ny;
+	int ns = xsmall ? nx : ny, nb = xsmall ? ny : nx;
+	const int *si = ns ? (xsmall ? &x.idx[0] : &y.idx[0]) : NULL;
+	const int *bi = nb ? (xsmall ? &y.idx[0] : &x.idx[0]) : NULL;
+	const double *sv = ns ? (xsmall ? &x.val[0] : &y.val[0]) : NULL;
+	const double *bv = nb ? (xsmall ? &y.val[0] : &x.val[0]) : NULL;
+	double sa = xsmall ? a : b, ba = xsmall ? b : a;
+
+	vector<int> ridx;
+	vector<double> rval;
+	if(par_threshold > 0 && ns + nb >= par_threshold && ThreadPool::threads() > 1)
+		merge_partitioned(si, sv, ns, sa, bi, bv, nb, ba, x.size_, par_grain, ridx, rval);
+	else{
+		SparseBufferPool::acquire(ridx, rval, ns + nb);
+
+		int i = 0;
+		for(int j = 0; j < ns; j++){
+			int p = gallop(bi, i, nb, si[j]);
+			for(; i < p; i++) ridx.push_back(bi[i]), rval.push_back(ba*bv[i]);
+			if(i < nb && bi[i] == si[j]){
+				double v = ba*bv[i] + sa*sv[j];
+				if(fabs(v) >= 1e-10) ridx.push_back(si[j]), rval.push_back(v);
+				i++;
+			}
+			else ridx.push_back(si[j]), rval.push_back(sa*sv[j]);
+		}
+		for(; i < nb; i++) ridx.push_back(bi[i]), rval.push_back(ba*bv[i]);
+	}
+
+	idx.swap(ridx);
+	val.swap(rval);
+	sorted = true;
+	pos_valid = false;
+	size_ = x.size_;
+	SparseBufferPool::release(ridx, rval);
+}
+
+void MySparseVector::update_sparse(double b, MySparseVector &y){
+	int n = idx.size(), m = y.idx.size(), added = 0, dropped = 0;
+	vector<int> at(m);
+
+	// locate every entry of y, updating the ones already present
+	for(int j = 0, lo = 0; j < m; j++){
+		lo = at[j] = gallop(n ? &idx[0] : NULL, lo, n, y.idx[j]);
+		if(lo < n && idx[lo] == y.idx[j]){
+			val[lo] += b*y.val[j];
+			if(fabs(val[lo]) < 1e-10) dropped++;
+		}
+		else added++;
+	}
+
+	// open gaps for the new entries, moving blocks from the back
+	if(added > 0){
+		idx.resize(n + added);
+		val.resize(n + added);
+		int hi = n, k = added;
+		for(int j = m-1; j >= 0 && k > 0; j--){
+			int p = at[j];
+			if(p < n && idx[p] == y.idx[j]) continue; // updated above
+			copy_backward(idx.begin() + p, idx.begin() + hi, idx.begin() + hi + k);
+			copy_backward(val.begin() + p, val.begin() + hi, val.begin() + hi + k);
+			k--;
+			idx[p+k] = y.idx[j];
+			val[p+k] = b*y.val[j];
+			hi = p;
+		}
+	}
+
+	// remove entries cancelled by the update
+	if(dropped > 0){
+		int w = 0;
+		for(int r = 0, nr = idx.size(); r < nr; r++)
+			if(fabs(val[r]) >= 1e-10) idx[w] = idx[r], val[w] = val[r], w++;
+		idx.resize(w);
+		val.resize(w);
+	}
+
+	if(added > 0 || dropped > 0) pos_valid = false;
+}
+
+MySparseVector& MySparseVector::axpby(double a, MySparseVector &x, double b, MySparseVector &y){
+	merge(a, x, b, y);
+	return *this;
 }
 
-MySparseVector::MySparseVector(int n) : size_(n), val(), sorted(true){
+MySparseVector& MySparseVector::lerp(MySparseVector &x, MySparseVector &y, double t){
+	merge(1-t, x, t, y);
+	return *this;
 }
 
 MySparseVector& MySparseVector::operator += (MySparseVector &x){
-  assert(x.size_ == size_);
-  sort(); x.sort();
-  list< pair<int, double> >::iterator it = val.begin(), itx = x.val.begin();
-  
-  while(it != val.end() && itx != x.val.end()){
-    if(it->first == itx->first){
-      it->second += itx->second;
-      ++itx;
-      if(fabs(it->second) < 1e-10) it = val.erase(it);
-      else ++it;
-    }
-    else if(it->first > itx->first){
-      val.insert(it, *itx);
-      ++itx;
-    }
-    else ++it;
-  }
-
-  while(itx != x.val.end()){
-    val.push_back(*itx);
-    ++itx;
-  }
-  return *this;
+	merge(1.0, *this, 1.0, x);
+	return *this;
 }
 
 MySparseVector& MySparseVector::operator -= (MySparseVector &x){
-  assert(x.size_ == size_);
-  sort(); x.sort();
-  list< pair<int, double> >::iterator it = val.begin(), itx = x.val.begin();
-
-  
-  while(it != val.end() && itx != x.val.end()){
-    if(it->first == itx->first){
-      it->second -= itx->second;
-      ++itx;
-      if(fabs(it->second) < 1e-10) it = val.erase(it);
-      else ++it;
-    }
-    else if(it->first > itx->first){
-      val.insert(it, make_pair(itx->first, -itx->second));
-      ++itx;
-    }
-    else ++it;
-  }
-
-  while(itx != x.val.end()){
-    val.push_back(make_pair(itx->first, -itx->second));
-    ++itx;
-  }
-  return *this;
+	merge(1.0, *this, -1.0, x);
+	return *this;
+}
+
+struct ScaleJob {
+	double *v;
+	int n;
+	double alpha;
+};
+
+// scaling splits the values evenly, no index ranges needed
+static void scale_chunk(int c, void *arg){
+	ScaleJob &s = *(ScaleJob*) arg;
+	int lo = (long long) s.n * c / PAR_CHUNKS, hi = (long long) s.n * (c+1) / PAR_CHUNKS;
+	for(int i = lo; i < hi; i++) s.v[i] *= s.alpha;
 }
 
 MySparseVector& MySparseVector::operator *= (double alpha){
-  if(alpha == 0.0){
-    val.clear();
-    return *this;
-  }
+	if(alpha == 0.0){
+		idx.clear();
+		val.clear();
+		sorted = true;
+		pos_valid = false;
+		return *this;
+	}
 
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-    it->second *= alpha;
-  return *this;
+	int n = val.size();
+	if(par_threshold > 0 && n >= par_threshold && ThreadPool::threads() > 1){
+		ScaleJob s = { &val[0], n, alpha };
+		ThreadPool::run(PAR_CHUNKS, scale_chunk, &s);
+	}
+	else for(int i = 0; i < n; i++) val[i] *= alpha;
+	return *this;
 }
 
 double& MySparseVector::insert(int i){
 	assert(i<size_);
-	if(val.empty()){
-		val.push_back(make_pair(i, 0.0));
-		return val.back().second;
-	}
-  if(sorted){
-    if(val.front().first > i){
-      val.push_front(make_pair(i, 0.0));
-      return val.front().second;
-    }
-    if(val.back().first < i){
-      val.push_back(make_pair(i, 0.0));
-      return val.back().second;
-    }
-  }
-  val.push_back(make_pair(i, 0.0));
-  sorted = false;
-  return val.back().second;
+	if(sorted && !idx.empty() && idx.back() >= i) sorted = false;
+	if(use_pos && pos_valid){
+		if(pos[i] >= 0) pos_valid = false; // duplicate, combined by sort()
+		else pos[i] = idx.size();
+	}
+	idx.push_back(i);
+	val.push_back(0.0);
+	return val.back();
+}
+
+int MySparseVector::find(int i) const{
+	if(use_pos){
+		if(!pos_valid){
+			sort();
+			pos.assign(size_, -1);
+			for(int j = 0, n = idx.size(); j < n; j++) pos[idx[j]] = j;
+			pos_valid = true;
+		}
+		return pos[i];
+	}
+
+	sort();
+	vector<int>::const_iterator it = lower_bound(idx.begin(), idx.end(), i);
+	if(it == idx.end() || *it != i) return -1;
+	return it - idx.begin();
 }
 
 double& MySparseVector::operator[](int i){
 	assert(i<size_);
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-    if(it->first == i) return it->second;
-  return insert(i);
+	int j = find(i);
+	if(j >= 0) return val[j];
+	// inserting below the last index would shift both arrays; switch to the
+	// position map instead, so that this and later scattered writes append
+	if(!use_pos && !idx.empty() && idx.back() > i) enable_position_map();
+	return insert(i);
+}
+
+void MySparseVector::enable_position_map(bool on){
+	use_pos = on;
+	pos_valid = false;
+	if(!on) vector<int>().swap(pos);
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+// Sum of a[i]*b[j] over matching indices a_idx[i] == b_idx[j], for blocks
+// of 8 indices from each side: every block of a is compared against the 8
+// rotations of the current block of b, and the block whose last index is
+// smaller is then skipped. Matches within a block pair are accumulated in
+// index order, so the result is bit-identical to the scalar loop. On
+// return i and j point to the first entries not yet consumed.
+__attribute__((target("avx2")))
+static double intersect_dot_avx2(const int *a_idx, const double *a, int n,
+                                 const int *b_idx, const double *b, int m,
+                                 int &i, int &j, double sum){
+	const __m256i rot = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+	while(i + 8 <= n && j + 8 <= m){
+		__m256i va = _mm256_loadu_si256((const __m256i*) (a_idx + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*) (b_idx + j));
+		int partner[8], any = 0;
+		for(int r = 0; r < 8; r++){
+			int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(va, vb)));
+			any |= mask;
+			for(; mask; mask &= mask-1) partner[__builtin_ctz(mask)] = r;
+			vb = _mm256_permutevar8x32_epi32(vb, rot);
+		}
+		for(; any; any &= any-1){
+			int l = __builtin_ctz(any);
+			sum += a[i+l] * b[j + ((l + partner[l]) & 7)];
+		}
+
+		int la = a_idx[i+7], lb = b_idx[j+7];
+		if(la <= lb) i += 8;
+		if(lb <= la) j += 8;
+	}
+	return sum;
+}
+
+static bool has_avx2(){
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+#endif
+
+// sum of a[i]*b[j] over the common indices of a_idx[0..n) and b_idx[0..m)
+static double intersect_dot(const int *a_idx, const double *a, int n,
+                            const int *b_idx, const double *b, int m){
+	int i = 0, j = 0;
+	double sum = 0.0;
+#ifdef HAVE_AVX2_DISPATCH
+	if(n >= 8 && m >= 8 && has_avx2())
+		sum = intersect_dot_avx2(a_idx, a, n, b_idx, b, m, i, j, sum);
+#endif
+	while(i < n && j < m){
+		if(a_idx[i] == b_idx[j]) sum += a[i++] * b[j++];
+		else if(a_idx[i] > b_idx[j]) j++;
+		else i++;
+	}
+	return sum;
+}
+
+struct DotJob {
+	const int *ai, *bi;
+	const double *av, *bv;
+	int n, m, len;
+	vector<double> partial; // sum of each chunk
+};
+
+static void dot_chunk(int c, void *arg){
+	DotJob &d = *(DotJob*) arg;
+	int a0, a1, b0, b1;
+	chunk_range(d.ai, d.n, d.len, c, a0, a1);
+	chunk_range(d.bi, d.m, d.len, c, b0, b1);
+	d.partial[c] = intersect_dot(d.ai + a0, d.av + a0, a1 - a0, d.bi + b0, d.bv + b0, b1 - b0);
 }
 
 double MySparseVector::dot(MySparseVector & x){
-  assert(x.size_ == size_);
-  sort(); x.sort();
-  list< pair<int, double> >::iterator it = val.begin(), itx = x.val.begin();
-  double sum = 0.0;
-  
-  while(it != val.end() && itx != x.val.end()){
-    if(it->first == itx->first){
-      sum += ((it->second) * (itx->second));
-      ++it; ++itx;
-    }
-    else if(it->first > itx->first) ++itx;
-    else ++it;
-  }
-  return sum;
+	assert(x.size_ == size_);
+	sort(); x.sort();
+	int n = idx.size(), nx = x.idx.size(), j = 0;
+	double sum = 0.0;
+
+	// skewed operands: look up each entry of the smaller one by galloping
+	if(n*SKEW <= nx || nx*SKEW <= n){
+		bool small = n <= nx;
+		const MySparseVector &s = small ? *this : x, &l = small ? x : *this;
+		int ns = s.idx.size(), nl = l.idx.size();
+		for(int p = 0; j < ns && p < nl; j++){
+			p = gallop(&l.idx[0], p, nl, s.idx[j]);
+			if(p < nl && l.idx[p] == s.idx[j]) sum += s.val[j] * l.val[p];
+		}
+		return sum;
+	}
+
+	const int *pi = n ? &idx[0] : NULL, *xi = nx ? &x.idx[0] : NULL;
+	const double *pv = n ? &val[0] : NULL, *xv = nx ? &x.val[0] : NULL;
+	if(par_threshold > 0 && n + nx >= par_threshold){
+		DotJob d = { pi, xi, pv, xv, n, nx, chunk_length(size_, par_grain), vector<double>(PAR_CHUNKS) };
+		ThreadPool::run(PAR_CHUNKS, dot_chunk, &d);
+		for(int c = 0; c < PAR_CHUNKS; c++) sum += d.partial[c];
+		return sum;
+	}
+	return intersect_dot(pi, pv, n, xi, xv, nx);
 }
 
 bool MySparseVector::operator ==(MySparseVector & x){
-  sort(); x.sort();
-  list< pair<int, double> >::iterator it = val.begin(), itx = x.val.begin();
-  double sum = 0.0;
-  
-  while(it != val.end() && itx != x.val.end()){
-    if(it->first == itx->first){
-	    if(fabs(it->second - itx->second) > 1e-8) return false;
-      ++it; ++itx;
-    }
-    else if(it->first > itx->first) 
-	    if(fabs(itx->second) > 1e-8) return false;
-	    else ++itx;
-    else 
-	    if(fabs(it->second) > 1e-8) return false;
-	    else ++it;
-  }
-
-  while(it != val.end()) 
-	  if(fabs(it->second) > 1e-8) return false;
-	  else ++it;
-
-  while(itx != x.val.end()) 
-	  if(fabs(it->second) > 1e-8) return false;
-	  else ++itx;
-		                              
-  return true;
+	sort(); x.sort();
+	int n = idx.size(), nx = x.idx.size(), i = 0, j = 0;
+
+	while(i < n && j < nx){
+		if(idx[i] == x.idx[j]){
+			if(fabs(val[i] - x.val[j]) > 1e-8) return false;
+			i++; j++;
+		}
+		else if(idx[i] > x.idx[j])
+			if(fabs(x.val[j]) > 1e-8) return false;
+			else j++;
+		else
+			if(fabs(val[i]) > 1e-8) return false;
+			else i++;
+	}
+
+	for(; i < n; i++)  if(fabs(val[i]) > 1e-8) return false;
+	for(; j < nx; j++) if(fabs(x.val[j]) > 1e-8) return false;
+
+	return true;
+}
+
+struct NormJob {
+	const int *idx;
+	const double *val;
+	int n, len;
+	vector<double> partial;
+};
+
+static void norm_chunk(int c, void *arg){
+	NormJob &s = *(NormJob*) arg;
+	int lo, hi;
+	chunk_range(s.idx, s.n, s.len, c, lo, hi);
+	double sum = 0.0;
+	for(int i = lo; i < hi; i++) sum += sqr(s.val[i]);
+	s.partial[c] = sum;
 }
 
 double MySparseVector::squaredNorm() {
-  double sum = 0.0;
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-	  sum += sqr(it->second);
-  return sum;
+	sort(); // combines duplicate indices, which changes the count
+	double sum = 0.0;
+	int n = val.size();
+	if(par_threshold > 0 && n >= par_threshold){
+		NormJob s = { &idx[0], &val[0], n, chunk_length(size_, par_grain), vector<double>(PAR_CHUNKS) };
+		ThreadPool::run(PAR_CHUNKS, norm_chunk, &s);
+		for(int c = 0; c < PAR_CHUNKS; c++) sum += s.partial[c];
+		return sum;
+	}
+	for(int i = 0; i < n; i++) sum += sqr(val[i]);
+	return sum;
 }
 
 double MySparseVector::norm(){
-  return sqrt(squaredNorm());
+	return sqrt(squaredNorm());
 }
 
 void MySparseVector::output(){
-  sort();
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-    cout<<"["<<it->first<<"]="<<it->second<<endl;
+	sort();
+	for(int i = 0, n = idx.size(); i < n; i++)
+		cout<<"["<<idx[i]<<"]="<<val[i]<<endl;
 }
 
 int MySparseVector::size() const{
@@ -184,28 +673,167 @@ int MySparseVector::size() const{
 }
 
 int MySparseVector::nonZeros() const{
-	return val.size();
+	return idx.size();
 }
 
 bool MySparseVector::check(){
-  sort();
-  int i = -1;
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-    if(it->first <= i) return false;
-    else i = it->first;
-  return true;
-  
+	sort();
+	for(int i = 1, n = idx.size(); i < n; i++)
+		if(idx[i] <= idx[i-1]) return false;
+	return true;
 }
 
-double MySparseVector::coeff(int i){
-  for(list< pair<int, double> >::iterator it = val.begin();
-      it != val.end(); ++it)
-	  if(it->first == i) return it->second;
-  return 0.0;
+double MySparseVector::coeff(int i) const{
+	int j = find(i);
+	return j >= 0 ? val[j] : 0.0;
 }
 
 double& MySparseVector::coeffRef(int i){
 	return (*this)[i];
 }
 
+int MultiDot::operand(const MySparseVector &x){
+	for(int i = 0, n = operands.size(); i < n; i++)
+		if(operands[i] == &x) return i;
+	assert(int(operands.size()) < MAX_OPERANDS);
+	assert(operands.empty() || operands[0]->size() == x.size());
+	operands.push_back(&x);
+	return operands.size() - 1;
+}
+
+int MultiDot::add(const MySparseVector &x, const MySparseVector &y){
+	products.push_back(make_pair(operand(x), operand(y)));
+	results.push_back(0.0);
+	return products.size() - 1;
+}
+
+// sum of a[i]*b[i] for i < n
+static double block_dot(const double *a, const double *b, int n){
+	int i = 0;
+	double sum = 0.0;
+#ifdef __SSE2__
+	__m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+	for(; i + 4 <= n; i += 4){
+		s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+i),   _mm_loadu_pd(b+i)));
+		s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a+i+2), _mm_loadu_pd(b+i+2)));
+	}
+	double s[2];
+	_mm_storeu_pd(s, _mm_add_pd(s0, s1));
+	sum = s[0] + s[1];
+#endif
+	for(; i < n; i++) sum += a[i]*b[i];
+	return sum;
+}
+
+void MultiDot::compute(){
+	int m = operands.size(), np = products.size();
+	const int *pi[MAX_OPERANDS], *pend[MAX_OPERANDS];
+	const double *pv[MAX_OPERANDS];
+	vector<double> rows(m*BLOCK);
+
+	for(int o = 0; o < m; o++){
+		const MySparseVector &x = *operands[o];
+		x.sort();
+		int nz = x.idx.size();
+		pi[o] = nz ? &x.idx[0] : NULL;
+		pend[o] = pi[o] + nz;
+		pv[o] = nz ? &x.val[0] : NULL;
+	}
+	for(int p = 0; p < np; p++) results[p] = 0.0;
+
+	for(;;){
+		// gather the next block of the merged supports into dense rows
+		int nb = 0;
+		for(; nb < BLOCK; nb++){
+			int i = INT_MAX;
+			for(int o = 0; o < m; o++)
+				if(pi[o] != pend[o] && *pi[o] < i) i = *pi[o];
+			if(i == INT_MAX) break;
+			for(int o = 0; o < m; o++)
+				if(pi[o] != pend[o] && *pi[o] == i) rows[o*BLOCK + nb] = *pv[o], ++pi[o], ++pv[o];
+				else rows[o*BLOCK + nb] = 0.0;
+		}
+		if(nb == 0) break;
+
+		for(int p = 0; p < np; p++)
+			results[p] += block_dot(&rows[products[p].first*BLOCK],
+			                        &rows[products[p].second*BLOCK], nb);
+	}
+}
+
+SparseBuilder::SparseBuilder(int n_) : n(n_) {}
+
+void SparseBuilder::reserve(int nnz){
+	idx.reserve(nnz);
+	val.reserve(nnz);
+}
+
+void SparseBuilder::add(const int *i, const double *v, int m){
+	idx.insert(idx.end(), i, i+m);
+	val.insert(val.end(), v, v+m);
+}
+
+void SparseBuilder::add(SparseBuilder &b){
+	assert(b.n == n);
+	idx.insert(idx.end(), b.idx.begin(), b.idx.end());
+	val.insert(val.end(), b.val.begin(), b.val.end());
+	b.idx.clear();
+	b.val.clear();
+}
+
+// stable LSD radix sort of the pairs by index, RADIX_BITS bits per pass;
+// passes in which every index has the same digit are skipped
+void SparseBuilder::radix_sort(){
+	const int R = 1 << RADIX_BITS;
+	int m = idx.size();
+
+	bool ordered = true;
+	for(int j = 1; j < m && ordered; j++) ordered = idx[j-1] <= idx[j];
+	if(ordered) return;
+
+	tidx.resize(m);
+	tval.resize(m);
+	for(int shift = 0; shift < 31 && ((n-1) >> shift) > 0; shift += RADIX_BITS){
+		int start[R];
+		memset(start, 0, sizeof(start));
+		for(int j = 0; j < m; j++) start[(idx[j] >> shift) & (R-1)]++;
+		if(start[(idx[0] >> shift) & (R-1)] == m) continue;
+
+		for(int d = 0, s = 0; d < R; d++){
+			int c = start[d];
+			start[d] = s;
+			s += c;
+		}
+		for(int j = 0; j < m; j++){
+			int t = start[(idx[j] >> shift) & (R-1)]++;
+			tidx[t] = idx[j];
+			tval[t] = val[j];
+		}
+		idx.swap(tidx);
+		val.swap(tval);
+	}
+}
+
+void SparseBuilder::finalize(MySparseVector &x){
+	radix_sort();
+
+	int m = 0, nz = idx.size();
+	for(int j = 0; j < nz; j++)
+		if(m > 0 && idx[m-1] == idx[j]) val[m-1] += val[j];
+		else{
+			if(m > 0 && val[m-1] == 0.0) m--; // cancelled out
+			idx[m] = idx[j], val[m] = val[j], m++;
+		}
+	if(m > 0 && val[m-1] == 0.0) m--;
+	idx.resize(m);
+	val.resize(m);
+
+	// hand the arrays to x and keep its old ones for the next round
+	x.idx.swap(idx);
+	x.val.swap(val);
+	x.size_ = n;
+	x.sorted = true;
+	x.pos_valid = false;
+	idx.clear();
+	val.clear();
+}
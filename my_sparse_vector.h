@@ -1,7 +1,7 @@
 #ifndef __MY_SPARSE_VECTOR__
 #define __MY_SPARSE_VECTOR__
 
-#include <list>
+#include <vector>
 #include <iostream>
 #include <utility>
 #include <cstdio>
@@ -9,50 +9,248 @@
 
 using namespace std;
 
-class MySparseVector{
+// Base of the lazy vector expressions defined in my_sparse_expr.h
+template <class E> struct SparseExpr {
+	inline const E& derived() const { return static_cast<const E&>(*this); }
+};
+
+// Pool of recycled index/value buffers for MySparseVector.
+//
+// Declaring a SparseBufferPool makes it the active pool until it goes out of
+// scope (pools nest). While a pool is active, vectors that are destroyed or
+// whose storage is replaced by a merge hand their buffers to the pool, and
+// new vectors, copies and merge outputs take a best-fitting buffer from it,
+// so a solver loop that builds the same temporaries every iteration stops
+// calling the general-purpose allocator once it reaches steady state.
+// reset() marks an iteration boundary: buffers that were not reused during
+// the previous iteration are returned to the system.
+class SparseBufferPool {
  private:
-  list< pair<int, double> > val;
-  bool sorted;
+	struct Buffer {
+		vector<int> idx;
+		vector<double> val;
+		int epoch;
+	};
+
+	static const int MAX_BUFFERS = 64;
+	static SparseBufferPool *active;
+
+	SparseBufferPool *previous;
+	vector<Buffer> buffers;
+	int epoch;
+	long hits, misses;
+
+	SparseBufferPool(const SparseBufferPool &);
+	SparseBufferPool & operator = (const SparseBufferPool &);
+
+ public:
+	SparseBufferPool();
+	~SparseBufferPool();
+
+	void reset();
+	long nhits() const { return hits; }
+	long nmisses() const { return misses; }
+
+	// give idx/val (empty on return) storage for at least n entries
+	static void acquire(vector<int> &idx, vector<double> &val, int n);
+	// take over the storage of idx/val (empty on return)
+	static void release(vector<int> &idx, vector<double> &val);
+};
+
+// Sparse vector stored as two parallel arrays (structure-of-arrays):
+// idx holds the indices of the nonzeros, val the corresponding values.
+// Both arrays are kept sorted by index except after out-of-order inserts,
+// in which case they are sorted lazily by the next operation that needs
+// the ordering (iterators, merges, dot products). Sorting does not change
+// the vector's value, so it is allowed on const vectors.
+//
+// Point access (coeff, coeffRef, operator[]) is a binary search over the
+// sorted indices. Vectors that are filled by scattered point writes can
+// additionally keep a dense index -> position map (enable_position_map),
+// which makes point reads and writes O(1) at the cost of size() ints. The
+// map is turned on by the first write to a missing index below the largest
+// one, so scattered writes append rather than insert in the middle.
+// References returned by operator[], coeffRef and insert are invalidated by
+// the next write that adds an index and by anything that sorts the vector.
+class MySparseVector : public SparseExpr<MySparseVector> {
+	friend class SparseTerm;
+	friend class MultiDot;
+	friend class SparseBuilder;
+
+ private:
+	mutable vector<int> idx;
+	mutable vector<double> val;
+	mutable bool sorted;
 	int size_;
 
-  void sort();
+	// optional dense position map: pos[i] is the position of index i
+	// in idx/val or -1; rebuilt lazily after structural changes
+	bool use_pos;
+	mutable bool pos_valid;
+	mutable vector<int> pos;
+
+	void sort() const;
+	int find(int i) const; // position of index i in idx/val, -1 if absent
+
+	// this = a*x + b*y in one streaming merge pass over both supports;
+	// x and/or y may alias this
+	void merge(double a, MySparseVector &x, double b, MySparseVector &y);
+
+	// this += b*y in place, for y much sparser than this
+	void update_sparse(double b, MySparseVector &y);
+
+	// partitioned operations (see set_parallel)
+	static int par_threshold, par_grain;
 
  public:
-	typedef pair<int, double> IVPair;
-	typedef list<IVPair> IVPairL;
-	class iterator : public IVPairL::iterator {
-		MySparseVector *v;
+	class iterator {
+		const int *pi, *pend;
+		const double *pv;
 	public:
-		iterator(MySparseVector *v_): v(v_), IVPairL::iterator(v_->val.begin()){}
-		inline bool end(){ return (*this) == v->val.end();}
-		inline int index(){ return (*this)->first; }
-		inline double value(){ return (*this)->second; }
+		iterator(const MySparseVector *v_);
+		inline bool end(){ return pi == pend; }
+		inline int index(){ return *pi; }
+		inline double value(){ return *pv; }
+		inline iterator& operator ++ (){ ++pi; ++pv; return *this; }
 	};
-	
-	iterator get_iterator();
 
-  MySparseVector(int n);
+	iterator get_iterator() const;
+
+	MySparseVector(int n);
+	MySparseVector(const MySparseVector &);
+	MySparseVector & operator = (const MySparseVector &);
+	~MySparseVector();
+
+	// O(1) exchange of the contents of two vectors (no copy); solver loops
+	// use it to rotate iterates instead of deep-copying them
+	void swap(MySparseVector &);
+
+#if __cplusplus >= 201103L
+	// moves leave the source empty (but of the same size)
+	MySparseVector(MySparseVector &&);
+	MySparseVector & operator = (MySparseVector &&);
+#endif
+
+	// evaluation of lazy expressions (x + y, x - y, a*x, see my_sparse_expr.h)
+	template <class E> MySparseVector(const SparseExpr<E> &);
+	template <class E> MySparseVector & operator = (const SparseExpr<E> &);
+	template <class E> MySparseVector & operator += (const SparseExpr<E> &);
+	template <class E> MySparseVector & operator -= (const SparseExpr<E> &);
+	template <class E> double dot(const SparseExpr<E> &);
+	template <class E> void assign(const SparseExpr<E> &);
 
-  MySparseVector & operator += (MySparseVector &);
-  MySparseVector & operator -= (MySparseVector &);
-  MySparseVector & operator *= (double);
+	MySparseVector & operator += (MySparseVector &);
+	MySparseVector & operator -= (MySparseVector &);
+	MySparseVector & operator *= (double);
 	bool operator == (MySparseVector &);
 
-  double & insert(int);
-  double & operator[](int);
-	double coeff(int);
+	// fused single-pass updates (x and y may alias this)
+	MySparseVector & axpby(double a, MySparseVector &x, double b, MySparseVector &y);
+	MySparseVector & lerp(MySparseVector &x, MySparseVector &y, double t); // x + t*(y-x)
+
+	double & insert(int);
+	double & operator[](int);
+	double coeff(int) const;
 	double & coeffRef(int);
+	void enable_position_map(bool on = true);
+
+	// Operations on vectors with at least threshold nonzeros split the
+	// index range into chunks whose length is a multiple of grain (K for
+	// flow vectors, so that chunks end on arc boundaries) and process the
+	// chunks on the ThreadPool. Dot products and norms above the threshold
+	// are summed chunk by chunk in a fixed order whatever the number of
+	// threads, so results are reproducible. threshold <= 0 keeps every
+	// operation serial.
+	static void set_parallel(int threshold, int grain = 1);
 
-  double dot(MySparseVector &);
-  double squaredNorm();
-  double norm();
+	double dot(MySparseVector &);
+	double squaredNorm();
+	double norm();
 
 	int size() const;
 	int nonZeros() const;
 	bool check();
 
-  void output();
-  
+	void output();
+
+};
+
+inline void swap(MySparseVector &x, MySparseVector &y){
+	x.swap(y);
+}
+
+namespace std {
+	template <> inline void swap(MySparseVector &x, MySparseVector &y){
+		x.swap(y);
+	}
+}
+
+// Batched inner products: computes a set of dot products and squared norms
+// over a few shared operands in a single traversal of their supports.
+//
+//   MultiDot md;
+//   int zg = md.add(z, g), zz = md.add(z, z), gg = md.add(g, g);
+//   md.compute();
+//   cosine = 1 + md[zg]/sqrt(md[zz]*md[gg]);
+//
+// The merged supports are gathered block by block into dense rows (zero
+// where an operand has no entry), and each requested product is then
+// accumulated over the block with SIMD instructions.
+class MultiDot {
+ private:
+	static const int MAX_OPERANDS = 8;
+	static const int BLOCK = 256;
+
+	vector<const MySparseVector*> operands;
+	vector< pair<int, int> > products;
+	vector<double> results;
+
+	int operand(const MySparseVector &x);
+
+ public:
+	int add(const MySparseVector &x, const MySparseVector &y);
+	void compute();
+	double operator [] (int i) const { return results[i]; }
 };
 
+// Collects (index, value) pairs in any order and turns them into a
+// MySparseVector in one go:
+//
+//   SparseBuilder b(n);
+//   b.add(i, v); ...
+//   b.finalize(x);
+//
+// finalize() sorts the pairs with an LSD radix sort on the index (linear in
+// the number of pairs), adds up the values of repeated indices (dropping
+// the ones that cancel out) and moves the arrays into x without copying;
+// x's previous storage is kept as scratch space for the next round, so a
+// builder that is reused across iterations does not allocate once its
+// buffers are large enough.
+class SparseBuilder {
+ private:
+	static const int RADIX_BITS = 8;
+
+	int n;
+	vector<int> idx, tidx;
+	vector<double> val, tval;
+
+	void radix_sort();
+
+ public:
+	SparseBuilder(int n);
+
+	void reserve(int nnz);
+	inline void add(int i, double v) { idx.push_back(i); val.push_back(v); }
+	void add(const int *i, const double *v, int m);
+	// moves the pairs pending in b into this builder (b keeps its buffers)
+	void add(SparseBuilder &b);
+	inline int pending() const { return idx.size(); }
+
+	// x becomes the vector of size n holding the pairs added so far;
+	// the builder is empty afterwards
+	void finalize(MySparseVector &x);
+};
+
+#include "my_sparse_expr.h"
+
 #endif
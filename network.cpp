@@ -1,4 +1,6 @@
 #include "network.h"
+#include "arc_cursor.h"
+#include "parallel.h"
 
 //////////////////////////////////////////////////////////////
 ////////// Arc and Commodity Flow constructors
@@ -32,12 +34,18 @@ void Graph::write_pajek(const char* filename){
 	fstream f(filename, fstream::out);
 	int V = getNVertex();
 	f<<"*Vertices "<<V<<endl;
-	FOR(i,V) f<<i+1<<" \""<<i+1<<"\""<<endl;
+	FOR(i,V) f<<i+1<<" \""<<(vertex_id.empty() ? i : vertex_id[i])+1<<"\""<<endl;
 	f<<"*Arcs*"<<endl;
 	FOR(i,arcs.size()) f<<arcs[i].head+1<<" "<<arcs[i].tail+1<<endl;
 	f.close();
 }
 
+double Graph::label_span() const{
+	double s = 0;
+	FOR(a, arcs.size()) s += abs(arcs[a].head - arcs[a].tail);
+	return arcs.empty() ? 0.0 : s / arcs.size();
+}
+
 //////////////////////////////////////////////////////////////
 ////////// Single commodity Network constructors
 //////////
@@ -221,89 +229,657 @@ MultiCommoNetwork::MultiCommoNetwork(const char * filename, FileFormat format)
 }
 
 
+void MultiCommoNetwork::renumber(const string &order){
+	if(order == "file") return;
+	if(order != "bfs" && order != "rcm")
+		error_handle("Unknown vertex order \"" + order + "\"");
+	bool rcm = order == "rcm";
+	int V = getNVertex(), A = arcs.size();
+
+	// undirected adjacency
+	vector<int> xadj(V+1, 0), adj(2*A), pos;
+	FOR(a, A) xadj[arcs[a].head+1]++, xadj[arcs[a].tail+1]++;
+	FOR(v, V) xadj[v+1] += xadj[v];
+	pos.assign(xadj.begin(), xadj.end() - 1);
+	FOR(a, A) adj[pos[arcs[a].head]++] = arcs[a].tail, adj[pos[arcs[a].tail]++] = arcs[a].head;
+
+	// each component from a pseudo-peripheral vertex (the last one reached
+	// from its lowest vertex), neighbours by increasing degree for rcm
+	vector<int> perm, mark(V, -1);
+	vector< pair<int, int> > nb; // (degree, vertex)
+	perm.reserve(V);
+	FOR(v0, V){
+		if(mark[v0] == -2) continue;
+		int start = perm.size(), src = v0;
+		perm.push_back(v0); mark[v0] = v0;
+		for(int h = start; h < int(perm.size()); h++)
+			for(int j = xadj[perm[h]]; j < xadj[perm[h]+1]; j++)
+				if(mark[adj[j]] != v0) mark[adj[j]] = v0, perm.push_back(adj[j]);
+		src = perm.back();
+		perm.resize(start);
+
+		perm.push_back(src); mark[src] = -2;
+		for(int h = start; h < int(perm.size()); h++){
+			int v = perm[h];
+			nb.clear();
+			for(int j = xadj[v]; j < xadj[v+1]; j++)
+				if(mark[adj[j]] != -2){
+					mark[adj[j]] = -2;
+					nb.push_back(make_pair(rcm ? xadj[adj[j]+1] - xadj[adj[j]] : 0, adj[j]));
+				}
+			if(rcm) sort(nb.begin(), nb.end());
+			FOR(i, nb.size()) perm.push_back(nb[i].second);
+		}
+	}
+	if(rcm) reverse(perm.begin(), perm.end());
+
+	vector<int> id(V), fid(V);
+	FOR(i, V) id[perm[i]] = i;
+	FOR(i, V) fid[i] = vertex_id.empty() ? perm[i] : vertex_id[perm[i]];
+	vertex_id.swap(fid);
+
+	FOR(a, A) arcs[a].head = id[arcs[a].head], arcs[a].tail = id[arcs[a].tail];
+	FOR(k, commoflows.size())
+		commoflows[k].origin = id[commoflows[k].origin],
+		commoflows[k].destination = id[commoflows[k].destination];
+
+	vector< pair< pair<int, int>, int > > by(A);
+	FOR(a, A) by[a] = make_pair(make_pair(arcs[a].head, arcs[a].tail), a);
+	sort(by.begin(), by.end());
+	vector<NetworkArc> sorted;
+	vector<int> aid(A);
+	sorted.reserve(A);
+	FOR(a, A){
+		sorted.push_back(arcs[by[a].second]);
+		aid[a] = arc_id.empty() ? by[a].second : arc_id[by[a].second];
+	}
+	arcs.swap(sorted);
+	arc_id.swap(aid);
+}
+
+DijkstraWorkspace::DijkstraWorkspace(int V, queue_kind kind) : epoch(0) {
+	queue = new_queue(kind, V);
+	d     = MALLOC(cost_t,   V);
+	stamp = MALLOC(unsigned, V);
+	vb    = MALLOC(char,     V);
+	touched = MALLOC(vertex_t, V);
+	oldpred = MALLOC(arc_t,    V);
+	below   = MALLOC(double,   V);
+	nchild  = MALLOC(int,      V);
+	FOR(i, V) stamp[i] = 0, vb[i] = 0;
+}
+
+DijkstraWorkspace::~DijkstraWorkspace(){
+	free_queue(queue);
+	FREE(d);
+	FREE(stamp);
+	FREE(vb);
+	FREE(touched);
+	FREE(oldpred);
+	FREE(below);
+	FREE(nchild);
+}
+
+void DijkstraWorkspace::set_queue(int V, queue_kind kind){
+	if(queue_type(queue) == kind) return;
+	free_queue(queue);
+	queue = new_queue(kind, V);
+}
+
+unsigned DijkstraWorkspace::next_epoch(int V){
+	if(++epoch == 0){ // wrapped around: stamps of old searches would match
+		FOR(i, V) stamp[i] = 0;
+		epoch = 1;
+	}
+	return epoch;
+}
+
 ShortestPathOracle::ShortestPathOracle(const MultiCommoNetwork &n):
 	net(n), V(n.getNVertex()), A(n.arcs.size()), K(n.commoflows.size()),
-	indexarcl(V), indexadjl(V), trace(V), vb(V), nv(V, 0)
+	adjarc(A), arcpos(A), slot(V, -1), queue(default_queue), tune_queue(default_auto),
+	backend(BACKEND_DIJKSTRA), cch(NULL), dynamic(false), have_trees(false), builder(A*K)
 {
+	tails = NULL;
+	in.first = in.arcs = NULL;
+
+	// trees from the side of the commodities with fewer distinct vertices
+	reverse = default_direction == DIRECTION_REVERSE;
+	if(default_direction == DIRECTION_AUTO){
+		vector<char> is_origin(V, 0), is_dest(V, 0);
+		int norigins = 0, ndests = 0;
+		FOR(k, K){
+			int o = net.commoflows[k].origin, d = net.commoflows[k].destination;
+			if(!is_origin[o]) is_origin[o] = 1, norigins++;
+			if(!is_dest[d]) is_dest[d] = 1, ndests++;
+		}
+		reverse = ndests < norigins;
+	}
+
 	adjl.V = V; adjl.A = A;
 	malloc_adjl(&adjl);
 
-	FOR(i, V) trace[i] = MALLOC(vertex_t, V);
-	FOR(i, V) vb[i] = MALLOC(char, V);
-  
-	FOR(i,V)  
-		indexarcl[i] = vector<arc_t>(V, -1), 
-		indexadjl[i] = vector<arc_t>(V, -1);
-  
+	// arcs leave the head, or the tail in the reversed graph
+	vector<int> from(A), to(A);
+	FOR(a, A){
+		from[a] = reverse ? net.arcs[a].tail : net.arcs[a].head;
+		to[a]   = reverse ? net.arcs[a].head : net.arcs[a].tail;
+	}
+
 	FOR(i, V+1) adjl.n_arcs[i] = 0;
-	FOR(a, A)   adjl.n_arcs[net.arcs[a].head]++;
+	FOR(a, A)   adjl.n_arcs[from[a]+1]++;
 	FOR(i, V)   adjl.n_arcs[i+1] += adjl.n_arcs[i];
-    
+
+	// arcs of a vertex in the order of net.arcs
+	vector<int> next(adjl.n_arcs, adjl.n_arcs + V);
+	in_order = true;
 	FOR(a, A) {
-		int aa =  --adjl.n_arcs[net.arcs[a].head];
-		int u = net.arcs[a].head, v = net.arcs[a].tail;
-		indexarcl [u] [v] = a;
-		indexadjl [u] [v] = aa;
-		adjl.adjacent_vertices[aa] = net.arcs[a].tail;
+		int aa = next[from[a]]++;
+		adjarc[aa] = a;
+		arcpos[a] = aa;
+		adjl.adjacent_vertices[aa] = to[a];
+		if(aa != a) in_order = false;
 	}
-  
-	FOR(i, V) FOR(j, V) vb[i][j]= 0;
-	FOR(k, net.commoflows.size()) {
-		vb[net.commoflows[k].origin][net.commoflows[k].destination] = 1;
-		nv[net.commoflows[k].origin]++;
-	}  
-
-	heap = MALLOC(vertex_t, V);
-	pos  = MALLOC(index_t,  V);
-	d = MALLOC(cost_t, V);
-  
+
+	// commodities and distinct leaves of every root, grouped by root
+	vector< pair< pair<int, int>, int > > od(K);
+	FOR(k, K) od[k] = make_pair(make_pair(root(k), leaf(k)), k);
+	sort(od.begin(), od.end());
+	FOR(i, od.size()){
+		int u = od[i].first.first, v = od[i].first.second;
+		if(slot[u] < 0){
+			slot[u] = origins.size();
+			origins.push_back(u);
+			first.push_back(targets.size());
+			cfirst.push_back(commos.size());
+		}
+		commos.push_back(od[i].second);
+		if(i == 0 || od[i-1].first != od[i].first) targets.push_back(v);
+	}
+	first.push_back(targets.size());
+	cfirst.push_back(commos.size());
+	pred.assign(origins.size() * size_t(V), -1);
+
+	vector< pair<int, int> > order(origins.size());
+	FOR(s, origins.size()) order[s] = make_pair(first[s] - first[s+1], s);
+	sort(order.begin(), order.end());
+	schedule.resize(origins.size());
+	FOR(s, origins.size()) schedule[s] = order[s].second;
 
 	has_solved = false;
+	if(default_backend != BACKEND_DIJKSTRA) cch = new ContractionHierarchy(adjl);
+	backend = default_backend;
 }
 
 ShortestPathOracle::~ShortestPathOracle(){
-	FOR(i, V){
-		FREE(vb[i]);
-		FREE(trace[i]);
-	}
-	FREE(heap);
-	FREE(pos);
-	FREE(d);
+	FOR(t, work.size()) delete work[t];
+	FOR(t, cwork.size()) delete cwork[t];
+	delete cch;
+	free_tails(tails);
+	free_in_arcs(&in);
 	free_adjl(&adjl);
 }
 
 extern fstream iteration_report;
 
-void ShortestPathOracle::solve(){
-	FOR(i, V) if(nv[i]>0) 
-		dijkstra(adjl, i, vb[i], nv[i], heap, pos, d, trace[i]);
+queue_kind ShortestPathOracle::default_queue = QUEUE_BINARY;
+bool ShortestPathOracle::default_auto = false;
+SearchBackend ShortestPathOracle::default_backend = BACKEND_DIJKSTRA;
+SearchDirection ShortestPathOracle::default_direction = DIRECTION_AUTO;
+
+// queue policy of a name, QUEUE_KINDS for "auto"
+static queue_kind queue_by_name(const string &name){
+	if(name == "auto") return QUEUE_KINDS;
+	FOR(q, QUEUE_KINDS) if(name == queue_name(queue_kind(q))) return queue_kind(q);
+	error_handle("Unknown shortest path queue \"" + name + "\"");
+	return QUEUE_BINARY;
+}
+
+void ShortestPathOracle::set_default_queue(const string &name){
+	queue_kind q = queue_by_name(name);
+	default_auto = q == QUEUE_KINDS;
+	if(!default_auto) default_queue = q;
+}
+
+void ShortestPathOracle::set_queue(const string &name){
+	queue_kind q = queue_by_name(name);
+	tune_queue = q == QUEUE_KINDS;
+	if(!tune_queue) queue = q;
+}
+
+static SearchBackend backend_by_name(const string &name){
+	if(name == "dijkstra") return BACKEND_DIJKSTRA;
+	if(name == "cch") return BACKEND_CCH;
+	if(name == "phast") return BACKEND_PHAST;
+	error_handle("Unknown shortest path backend \"" + name + "\"");
+	return BACKEND_DIJKSTRA;
+}
+
+void ShortestPathOracle::set_default_backend(const string &name){
+	default_backend = backend_by_name(name);
+}
+
+void ShortestPathOracle::set_backend(const string &name){
+	SearchBackend b = backend_by_name(name);
+	if(b == backend) return;
+	backend = b;
+	if(b == BACKEND_DIJKSTRA){
+		delete cch;
+		cch = NULL;
+	}
+	else if(!cch) cch = new ContractionHierarchy(adjl);
+	has_solved = false;
+}
+
+void ShortestPathOracle::set_default_direction(const string &name){
+	if(name == "auto") default_direction = DIRECTION_AUTO;
+	else if(name == "forward") default_direction = DIRECTION_FORWARD;
+	else if(name == "reverse") default_direction = DIRECTION_REVERSE;
+	else error_handle("Unknown shortest path direction \"" + name + "\"");
+}
+
+void ShortestPathOracle::prepare_threads(){
+	int T = ThreadPool::threads();
+	while(int(work.size()) < T) work.push_back(new DijkstraWorkspace(V, queue));
+	if(cch) while(int(cwork.size()) < T) cwork.push_back(new ContractionHierarchy::Workspace(V));
+	if(int(builders.size()) < T) builders.resize(T, SparseBuilder(A*K));
+	if(int(arcloads.size()) < T) arcloads.resize(T, DenseArcVector(A));
+
+	cost_t maxcost = 0;
+	FOR(a, A) updatemax(maxcost, adjl.costs[a]);
+	FOR(t, work.size()){
+		work[t]->set_queue(V, queue);
+		scale_queue(work[t]->queue, maxcost);
+	}
+}
+
+// times a full solve with every queue policy and keeps the fastest; the
+// trees of the last solve are kept, as every policy yields exact shortest
+// paths (ties may be broken differently, which does not change their costs)
+void ShortestPathOracle::choose_queue(){
+	queue_kind best = queue;
+	double best_time = 0.0;
+	FOR(q, QUEUE_KINDS){
+		queue = queue_kind(q);
+		prepare_threads();
+		Job job = { this, true, false, false, false, 1 };
+		Timer timer;
+		timer.record();
+		ThreadPool::run(origins.size(), run_origin, &job);
+		timer.record();
+		if(q == 0 || timer.elapsed() < best_time) best = queue, best_time = timer.elapsed();
+	}
+	queue = best;
+	tune_queue = false;
+}
+
+void ShortestPathOracle::set_costs(const double *c){
+	if(have_trees){
+		FOR(a, A){
+			arc_t p = arcpos[a];
+			if(adjl.costs[p] != cost_t(c[a])) note_change(p);
+			adjl.costs[p] = cost_t(c[a]);
+		}
+	}
+	else if(in_order) FOR(a, A) adjl.costs[a] = cost_t(c[a]);
+	else FOR(a, A) adjl.costs[arcpos[a]] = cost_t(c[a]);
+	has_solved = false;
+}
+
+void ShortestPathOracle::set_dynamic(bool on){
+	if(on == dynamic) return;
+	dynamic = on;
+	have_trees = has_solved = false;
+	changed.clear();
+	old_cost.clear();
+	free_tails(tails);
+	free_in_arcs(&in);
+	tails = NULL;
+	if(on){
+		tails = build_tails(adjl);
+		in = build_in_arcs(adjl);
+		dist.assign(origins.size() * size_t(V), COST_INF);
+		is_changed.assign(A, 0);
+		path_changed.assign(K, 1);
+		paths.assign(K, vector<int>());
+	}
+	else{
+		vector<cost_t>().swap(dist);
+		vector< vector<int> >().swap(paths);
+	}
+}
+
+void ShortestPathOracle::solve_origin(int s, DijkstraWorkspace &w){
+	if(dynamic){
+		if(have_trees) repair_origin(s, w);
+		else grow_origin(s, w);
+		return;
+	}
+
+	int b = first[s], e = first[s+1];
+	arc_t *p = &pred[s * size_t(V)];
+	if(cch){
+		cch->query(adjl, origins[s], &targets[b], e - b, *cwork[ThreadPool::thread_index()], p);
+		return;
+	}
+	unsigned epoch = w.next_epoch(V);
+	for(int t = b; t < e; t++) w.vb[targets[t]] = 1;
+	dijkstra(adjl, origins[s], w.vb, e - b, w.queue, w.d, p, w.stamp, epoch);
+	for(int t = b; t < e; t++){
+		w.vb[targets[t]] = 0;
+		if(w.stamp[targets[t]] != epoch) p[targets[t]] = -1; // unreachable
+	}
+}
+
+// full tree and labels of origins[s] (no targets marked: nothing stops it)
+void ShortestPathOracle::grow_origin(int s, DijkstraWorkspace &w){
+	arc_t *p = &pred[s * size_t(V)];
+	cost_t *d = &dist[s * size_t(V)];
+	unsigned epoch = w.next_epoch(V);
+	dijkstra(adjl, origins[s], w.vb, 1, w.queue, d, p, w.stamp, epoch);
+	FOR(v, V) if(w.stamp[v] != epoch) d[v] = COST_INF, p[v] = -1;
+	for(int c = cfirst[s]; c < cfirst[s+1]; c++) path_changed[commos[c]] = 1;
+}
+
+void ShortestPathOracle::repair_origin(int s, DijkstraWorkspace &w){
+	if(changed.empty()) return;
+	arc_t *p = &pred[s * size_t(V)];
+	cost_t *d = &dist[s * size_t(V)];
+	int nt = dijkstra_repair(adjl, tails, in, origins[s], &changed[0], &old_cost[0], changed.size(),
+	                         w.queue, d, p, w.stamp, w.next_epoch(V), w.touched, w.oldpred);
+
+	// a path has changed iff it passes a vertex whose tree arc changed
+	bool moved = false;
+	FOR(t, nt){
+		vertex_t v = w.touched[t];
+		if(p[v] != w.oldpred[v]) w.vb[v] = 1, moved = true;
+	}
+	if(!moved) return;
+	int u = origins[s];
+	for(int c = cfirst[s]; c < cfirst[s+1]; c++){
+		int k = commos[c];
+		for(int v = leaf(k); ; v = toward_root(adjarc[p[v]])){
+			if(w.vb[v]){
+				path_changed[k] = 1;
+				break;
+			}
+			if(v == u || p[v] < 0) break;
+		}
+	}
+	FOR(t, nt) w.vb[w.touched[t]] = 0;
+}
+
+void ShortestPathOracle::load_origin(int s, SparseBuilder &b){
+	const arc_t *p = &pred[s * size_t(V)];
+	int u = origins[s];
+	for(int c = cfirst[s]; c < cfirst[s+1]; c++){
+		int k = commos[c], v = leaf(k);
+		Real demand = net.commoflows[k].demand;
+		while(v != u && p[v] >= 0){
+			int a = adjarc[p[v]];
+			b.add(a*K + k, demand);
+			v = toward_root(a);
+		}
+	}
+}
+
+// old path out, new path in, for the commodities of origins[s] whose
+// path changed since the last get_flow_changes
+void ShortestPathOracle::load_changes(int s, SparseBuilder &b){
+	const arc_t *p = &pred[s * size_t(V)];
+	int u = origins[s];
+	for(int c = cfirst[s]; c < cfirst[s+1]; c++){
+		int k = commos[c], v = leaf(k);
+		if(!path_changed[k]) continue;
+		path_changed[k] = 0;
+
+		Real demand = net.commoflows[k].demand;
+		vector<int> &path = paths[k];
+		FOR(i, path.size()) b.add(path[i]*K + k, -demand);
+		path.clear();
+		while(v != u && p[v] >= 0){
+			int a = adjarc[p[v]];
+			b.add(a*K + k, demand);
+			path.push_back(a);
+			v = toward_root(a);
+		}
+	}
+}
+
+// adds the flow of the commodities of origins[s] on each arc to y: the
+// vertices of the paths are collected with the number of their children
+// on the paths, then every vertex passes the demand below it to its
+// parent once all its children have, leaves first
+void ShortestPathOracle::load_tree(int s, DijkstraWorkspace &w, double *y){
+	const arc_t *p = &pred[s * size_t(V)];
+	int u = origins[s], n = 0;
+	unsigned epoch = w.next_epoch(V);
+	vertex_t *list = w.touched;
+	for(int c = cfirst[s]; c < cfirst[s+1]; c++){
+		int k = commos[c], v = leaf(k);
+		if(w.stamp[v] != epoch){
+			w.stamp[v] = epoch, w.below[v] = 0.0, w.nchild[v] = 0, list[n++] = v;
+			while(v != u && p[v] >= 0){
+				int h = toward_root(adjarc[p[v]]);
+				if(w.stamp[h] == epoch){
+					w.nchild[h]++;
+					break;
+				}
+				w.stamp[h] = epoch, w.below[h] = 0.0, w.nchild[h] = 1, list[n++] = h;
+				v = h;
+			}
+			v = leaf(k);
+		}
+		w.below[v] += net.commoflows[k].demand;
+	}
+
+	// list[0 .. top) is the stack of vertices whose children are all loaded
+	int top = 0;
+	FOR(i, n) if(w.nchild[list[i]] == 0) list[top++] = list[i];
+	while(top > 0){
+		int v = list[--top];
+		if(v == u || p[v] < 0) continue;
+		int a = adjarc[p[v]], h = toward_root(a);
+		y[a] += w.below[v];
+		w.below[h] += w.below[v];
+		if(--w.nchild[h] == 0) list[top++] = h;
+	}
+}
+
+// origins schedule[b .. e) in one sweep of the hierarchy
+void ShortestPathOracle::solve_batch(int b, int e, int t){
+	const int L = ContractionHierarchy::LANES;
+	vertex_t us[L];
+	const vertex_t *tg[L];
+	int nt[L];
+	arc_t *ps[L];
+	for(int i = b; i < e; i++){
+		int s = schedule[i], l = i - b;
+		us[l] = origins[s];
+		tg[l] = &targets[first[s]];
+		nt[l] = first[s+1] - first[s];
+		ps[l] = &pred[s * size_t(V)];
+	}
+	cch->sweep(adjl, us, e - b, tg, nt, *cwork[t], ps);
+}
+
+void ShortestPathOracle::run_origin(int c, void *job){
+	Job &j = *(Job*) job;
+	ShortestPathOracle &o = *j.oracle;
+	int t = ThreadPool::thread_index();
+	int b = c * j.batch, e = min(b + j.batch, int(o.schedule.size()));
+	if(j.solve && j.batch > 1) o.solve_batch(b, e, t);
+	for(int i = b; i < e; i++){
+		int s = o.schedule[i];
+		if(j.solve && j.batch == 1) o.solve_origin(s, *o.work[t]);
+		if(j.load) o.load_origin(s, o.builders[t]);
+		if(j.totals) o.load_tree(s, *o.work[t], o.arcloads[t].data());
+		if(j.changes) o.load_changes(s, o.builders[t]);
+	}
+}
+
+void ShortestPathOracle::run(bool solve, bool load, bool changes, bool totals){
+	bool hierarchy = cch && !dynamic;
+	if(solve && tune_queue && !hierarchy){
+		choose_queue();
+		solve = false;
+	}
+	prepare_threads();
+	if(solve && hierarchy) cch->customize(adjl);
+	int batch = hierarchy && backend == BACKEND_PHAST ? ContractionHierarchy::LANES : 1;
+	Job job = { this, solve, load, changes, totals, batch };
+	int n = origins.size();
+	if(solve || load || changes || totals) ThreadPool::run((n + batch - 1) / batch, run_origin, &job);
 	has_solved = true;
+
+	if(dynamic){
+		FOR(j, changed.size()) is_changed[changed[j]] = 0;
+		changed.clear();
+		old_cost.clear();
+		have_trees = true;
+	}
 }
 
-void ShortestPathOracle::get_flows(Vector &sp, bool use_tmp) {
-	sp *= 0.0;
-	vector< list<arc_t> > *paths = use_tmp ? new vector< list<arc_t> >(A) : NULL;
+void ShortestPathOracle::solve(){
+	run(true, false);
+}
+
+void ShortestPathOracle::get_flows(Vector &sp) {
+	run(!has_solved, true);
+
+	// paths are emitted origin by origin, i.e. out of index order; the
+	// builder sorts them in linear time
+	FOR(t, builders.size()) builder.add(builders[t]);
+	builder.finalize(sp);
+}
+
+// y = the arc totals of the threads, which are cleared for the next call
+void ShortestPathOracle::sum_arcloads(DenseArcVector &y){
+	if(y.size() != A) DenseArcVector(A).swap(y);
+	else y.fill(0.0);
+	FOR(t, arcloads.size()){
+		y.axpby(1.0, y, 1.0, arcloads[t]);
+		arcloads[t].fill(0.0);
+	}
+}
+
+void ShortestPathOracle::get_flows(Vector &sp, DenseArcVector &y) {
+	run(!has_solved, true, false, true);
+	FOR(t, builders.size()) builder.add(builders[t]);
+	builder.finalize(sp);
+	sum_arcloads(y);
+}
+
+void ShortestPathOracle::get_arc_flows(DenseArcVector &y) {
+	run(!has_solved, false, false, true);
+	sum_arcloads(y);
+}
+
+void ShortestPathOracle::get_flow_changes(Vector &delta) {
+	if(!dynamic) error_handle("get_flow_changes: the oracle is not in dynamic mode");
+	run(!has_solved, false, true);
+	FOR(t, builders.size()) builder.add(builders[t]);
+	builder.finalize(delta);
+}
+
+void ShortestPathOracle::get_path(int k, vector<int> &path) {
 	if(!has_solved) solve();
+	path.clear();
+	const arc_t *p = tree(k);
+	int u = root(k), v = leaf(k);
+	while(v != u && p[v] >= 0){
+		int a = adjarc[p[v]];
+		path.push_back(a);
+		v = toward_root(a);
+	}
+	if(reverse) std::reverse(path.begin(), path.end()); // destination first
+}
+
+void prune_flows(const MultiCommoNetwork &net, ShortestPathOracle &DA, Vector &x, Real threshold){
+	int A = net.arcs.size(), K = net.commoflows.size();
+	typedef pair<int, Real> ArcFlow;
+
+	// commodity-major copy of the flows
+	vector< vector<ArcFlow> > flows(K);
+	for(ArcCursor<Vector> it(x, K); !it.end(); it.advance())
+		flows[it.commodity()].push_back(ArcFlow(it.arc(), it.value()));
+
+	SparseBuilder builder(A*K);
+	builder.reserve(x.nonZeros());
+	vector<int> sp, walk;
+	map<int, int> onwalk; // vertex -> number of walk arcs before it
 
 	FOR(k, K){
-		int u = net.commoflows[k].origin, v = net.commoflows[k].destination;
-		Real demand = net.commoflows[k].demand;
-		if(use_tmp)
-			while(v>=0 && v!=u){
-				(*paths)[indexarcl[trace[u][v]] [v]].push_back(k);
-				v = trace[u][v];
+		vector<ArcFlow> &f = flows[k];
+		int m = f.size();
+		int origin = net.commoflows[k].origin, destination = net.commoflows[k].destination;
+		Real demand = net.commoflows[k].demand, eps = 1e-12*demand, kept = 0.0, moved = 0.0;
+
+		// entries sorted by the vertex they leave
+		vector< pair<int, int> > out(m);
+		FOR(j, m) out[j] = make_pair(net.arcs[f[j].first].head, j);
+		sort(out.begin(), out.end());
+		vector<Real> rest(m), keep(m, 0.0);
+		FOR(j, m) rest[j] = f[j].second;
+
+		for(;;){
+			walk.clear(); onwalk.clear();
+			int v = origin;
+			onwalk[v] = 0;
+			while(v != destination){
+				vector< pair<int, int> >::iterator it = 
+					lower_bound(out.begin(), out.end(), make_pair(v, -1));
+				while(it != out.end() && it->first == v && rest[it->second] <= eps) ++it;
+				if(it == out.end() || it->first != v) break;
+				walk.push_back(it->second);
+				v = net.arcs[f[it->second].first].tail;
+
+				map<int, int>::iterator pv = onwalk.find(v);
+				if(pv == onwalk.end()){
+					onwalk[v] = walk.size();
+					continue;
+				}
+				// cancel the cycle walk[p..] and continue from v
+				int p = pv->second;
+				Real b = rest[walk[p]];
+				for(int i = p; i < int(walk.size()); i++) updatemin(b, rest[walk[i]]);
+				for(int i = p; i < int(walk.size()); i++){
+					rest[walk[i]] -= b;
+					int t = net.arcs[f[walk[i]].first].tail;
+					if(t != v) onwalk.erase(t);
+				}
+				walk.resize(p);
 			}
-		else
-			while(v>=0 && v!=u){
-				sp.insert(indexarcl[trace[u][v]][v]*K + k) = demand;
-				v = trace[u][v];
+
+			if(v != destination){
+				// dead end: what is left on the last arc is residue, made up
+				// on the shortest path below
+				if(walk.empty()) break;
+				rest[walk.back()] = 0.0;
+				continue;
 			}
+
+			if(walk.empty()) break; // origin == destination
+
+			Real b = rest[walk[0]];
+			FOR(i, walk.size()) updatemin(b, rest[walk[i]]);
+			FOR(i, walk.size()) rest[walk[i]] -= b;
+			if(b < threshold*demand) moved += b;
+			else{
+				FOR(i, walk.size()) keep[walk[i]] += b;
+				kept += b;
+			}
+		}
+
+		// the dropped residue is routed with the moved paths, so that the
+		// commodity still delivers its demand
+		if(kept + moved < demand) moved = demand - kept;
+
+		FOR(j, m) if(keep[j] > 0.0) builder.add(f[j].first*K + k, keep[j]);
+		if(moved > 0.0){
+			DA.get_path(k, sp);
+			FOR(i, sp.size()) builder.add(sp[i]*K + k, moved);
+		}
 	}
-  
-	if(use_tmp){
-		FOR(a, A)
-			for(list<arc_t>::iterator it = (*paths)[a].begin(); it != (*paths)[a].end(); ++it)
-				sp.insert(a*K + *it) = net.commoflows[*it].demand;
-		delete paths;
-	}
+
+	builder.finalize(x);
 }
@@ -3,6 +3,8 @@
 
 #include "cvputility.h"
 #include "dijkstra.h"
+#include "cch.h"
+#include "dense_arc_vector.h"
 
 using namespace std;
 
@@ -20,6 +22,14 @@ struct Graph {
 	vector<NetworkArc> arcs;  
 	int getNVertex() const;  
 	void write_pajek(const char* filename);
+
+	// numbering of the input file after a renumbering (empty before):
+	// vertex_id[v] is the file vertex of v, arc_id[a] the file arc of a
+	vector<int> vertex_id, arc_id;
+
+	// mean distance between the labels of the two ends of an arc, how far
+	// apart a search touches the per-vertex arrays
+	double label_span() const;
 };
 
 typedef pair<Vertex, Real> Sink;
@@ -52,44 +62,249 @@ struct MultiCommoNetwork : public Graph {
 
 	// construct by reading file
 	MultiCommoNetwork(const char* filename, FileFormat format);
+
+	// renumbers the vertices for locality, "bfs" or "rcm" (reverse
+	// Cuthill-McKee) order of the undirected graph, and sorts the arcs by
+	// the vertex they leave; "file" keeps the numbering of the file
+	void renumber(const string &order);
+};
+
+// Scratch arrays of a Dijkstra search (see dijkstra()); the oracle keeps
+// one per thread
+struct DijkstraWorkspace {
+	DijkstraQueue *queue;
+	cost_t   *d;
+	unsigned *stamp;
+	unsigned epoch;
+	char *vb;                // marks the targets of the current origin
+	vertex_t *touched;       // vertices relabelled by a tree repair
+	arc_t *oldpred;          // and their tree arcs before the repair
+	double *below;           // demand of the tree below a vertex (tree loading)
+	int *nchild;             // and its children not yet loaded
+
+	DijkstraWorkspace(int V, queue_kind kind);
+	~DijkstraWorkspace();
+
+	// switches to another queue policy
+	void set_queue(int V, queue_kind kind);
+
+	// epoch for the next search
+	unsigned next_epoch(int V);
+
+ private:
+	DijkstraWorkspace(const DijkstraWorkspace &);
+	DijkstraWorkspace & operator = (const DijkstraWorkspace &);
 };
 
+// Search backends of ShortestPathOracle
+enum SearchBackend { BACKEND_DIJKSTRA, BACKEND_CCH, BACKEND_PHAST };
+
+// Which end of the commodities the trees of ShortestPathOracle grow from
+enum SearchDirection { DIRECTION_AUTO, DIRECTION_FORWARD, DIRECTION_REVERSE };
+
+// Shortest paths of all commodities, one Dijkstra tree per origin with
+// demand. Memory is O(A + origins*V): the trees are stored as predecessor
+// arcs for the active origins only, and each origin keeps the sparse list
+// of its destinations.
+//
+// The origins are solved on the ThreadPool, those with the most
+// destinations first, each thread with its own workspace; get_flows loads
+// the paths of each origin right after solving it into a per-thread
+// builder, and the builders are merged at the end.
+//
+// The priority queue of the searches is a policy of dijkstra() (see
+// queue_kind). In auto mode the first solve is timed with every policy in
+// turn and the fastest one is kept.
+//
+// With the "cch" backend (set_backend) the searches are answered by a
+// ContractionHierarchy instead: it is built once from the topology and
+// customized with the current costs before each solve. The "phast"
+// backend uses the same hierarchy but computes whole trees, LANES origins
+// per sweep, which pays off when every origin has destinations nearly
+// everywhere. Dynamic mode always uses Dijkstra trees.
+//
+// In dynamic mode (set_dynamic) the oracle keeps the full tree and the
+// distance labels of every origin, and after cost changes it repairs the
+// trees with dijkstra_repair instead of growing them again. It then also
+// tracks which commodities changed path, so get_flow_changes can return
+// the path flows as a delta against the previous call.
+//
+// When there are fewer distinct destinations than origins (auto direction),
+// the oracle searches the reversed graph instead, one tree per destination
+// holding the arc out of each vertex towards it. Below, "origins" are then
+// the destinations, the roots of the trees; the path flows are the same.
 class ShortestPathOracle{
  private:
 	MultiCommoNetwork net;
 	int V, A, K;
 
+	bool reverse;             // adjl is the reversed graph, trees from destinations
+	static SearchDirection default_direction;
+
 	AdjacentList adjl;
-	vector< vector<arc_t> > indexarcl;
-	vector< vector<arc_t> > indexadjl;
-	vector< vertex_t * > trace;
-	vector< char * > vb;
-	vector< int > nv;
+	vector<int> adjarc;      // net arc of each adjacency list position
+	vector<arc_t> arcpos;    // and adjacency list position of each net arc
+	bool in_order;           // arcpos is the identity (arcs sorted by the vertex searched from)
+
+	vector<int> origins;     // vertices that are the origin of a commodity
+	vector<int> slot;        // slot[u]: position of u in origins, -1 if none
+	vector<int> first;       // targets of origins[s] are targets[first[s] .. first[s+1])
+	vector<vertex_t> targets;
+	vector<int> cfirst;      // commodities of origins[s] are commos[cfirst[s] .. cfirst[s+1])
+	vector<int> commos;
+	vector<int> schedule;    // origins by decreasing number of targets
+	vector<arc_t> pred;      // pred[s*V + v]: tree arc into v from origins[s]
+
+	vector<DijkstraWorkspace*> work; // per thread
+	vector<SparseBuilder> builders;  // per thread, for get_flows
+	vector<DenseArcVector> arcloads; // per thread, arc totals of get_flows
 
-	vertex_t *heap;
-	index_t  *pos;
-	cost_t *d;
+	queue_kind queue;
+	bool tune_queue;          // auto mode, not yet timed
+	static queue_kind default_queue;
+	static bool default_auto;
 
 	bool has_solved;
 
+	SearchBackend backend;
+	static SearchBackend default_backend;
+	ContractionHierarchy *cch; // cch and phast backends
+	vector<ContractionHierarchy::Workspace*> cwork; // per thread
+
+	// dynamic mode
+	bool dynamic, have_trees;
+	vertex_t *tails;              // tail vertex of each adjacency position
+	InArcs in;                    // and the positions entering each vertex
+	vector<cost_t> dist;          // dist[s*V + v]: label of v from origins[s]
+	vector<arc_t> changed;        // arcs whose cost changed since the last solve
+	vector<cost_t> old_cost;      // and their cost at that solve
+	vector<char> is_changed;
+	vector<char> path_changed;    // per commodity, since the last get_flow_changes
+	vector< vector<int> > paths;  // per commodity, as of the last get_flow_changes
+
+	inline void note_change(arc_t a){
+		if(is_changed[a]) return;
+		is_changed[a] = 1;
+		changed.push_back(a);
+		old_cost.push_back(adjl.costs[a]);
+	}
+
+	SparseBuilder builder; // assembles the path flows in get_flows
+
+	void prepare_threads();
+	void run(bool solve, bool load, bool changes = false, bool totals = false);
+	void choose_queue();
+	void solve_origin(int s, DijkstraWorkspace &w);
+	void solve_batch(int b, int e, int t);
+	void grow_origin(int s, DijkstraWorkspace &w);
+	void repair_origin(int s, DijkstraWorkspace &w);
+	void load_origin(int s, SparseBuilder &b);
+	void load_changes(int s, SparseBuilder &b);
+	void load_tree(int s, DijkstraWorkspace &w, double *y);
+	void sum_arcloads(DenseArcVector &y);
+
+	// job of solve(), get_flows() and get_flow_changes() for the c-th
+	// origin of the schedule
+	struct Job {
+		ShortestPathOracle *oracle;
+		bool solve, load, changes, totals;
+		int batch; // origins of the schedule per chunk
+	};
+	static void run_origin(int c, void *job);
+
 	void solve();
 
+	// root of the tree of commodity k, and the end its path is walked from
+	inline int root(int k) const {
+		return reverse ? net.commoflows[k].destination : net.commoflows[k].origin;
+	}
+	inline int leaf(int k) const {
+		return reverse ? net.commoflows[k].origin : net.commoflows[k].destination;
+	}
+	// next vertex towards the root after the tree arc a (a net arc)
+	inline int toward_root(int a) const {
+		return reverse ? net.arcs[a].tail : net.arcs[a].head;
+	}
+
+	// tree of the root of commodity k
+	inline const arc_t *tree(int k) const {
+		return &pred[size_t(slot[root(k)]) * V];
+	}
+
  public:
 	ShortestPathOracle(const MultiCommoNetwork &n);
 	~ShortestPathOracle();
 
 	void reset_cost(){
-		FOR(a, A) adjl.costs[a] = cost_t(0.0);
+		FOR(a, A){
+			if(have_trees && adjl.costs[a] != cost_t(0.0)) note_change(a);
+			adjl.costs[a] = cost_t(0.0);
+		}
+		has_solved = false;
 	}
 
+	// cost of the arc u -> v (the first one, if there are parallel arcs)
 	void set_cost(vertex_t u, vertex_t v, cost_t c){
-		arc_t a = indexadjl[u][v];
-		if(a>=0) adjl.costs[a] = c;
+		if(reverse) std::swap(u, v);
+		for(arc_t a = adjl.n_arcs[u]; a < adjl.n_arcs[u+1]; a++)
+			if(adjl.adjacent_vertices[a] == v){
+				if(have_trees && adjl.costs[a] != c) note_change(a);
+				adjl.costs[a] = c;
+				break;
+			}
 		has_solved = false;
 	}
 
-	void get_flows(Vector &sp, bool use_tmp = false);
+	// costs of all arcs, in the order of net.arcs (parallel arcs each get
+	// their own); replaces reset_cost() and a set_cost() per arc
+	void set_costs(const double *c);
+	void set_costs(const DenseArcVector &c){ set_costs(c.data()); }
+
+	// keep full trees and repair them after cost changes (see above)
+	void set_dynamic(bool on = true);
+
+	// queue policy by name: "binary", "4-ary", "radix", "dial", "slf-lll",
+	// or "auto"; set_default_queue applies to oracles created afterwards
+	static void set_default_queue(const string &name);
+	void set_queue(const string &name);
+	queue_kind get_queue() const { return queue; }
+
+	// search backend by name: "dijkstra", "cch" or "phast"; set_default_backend
+	// applies to oracles created afterwards
+	static void set_default_backend(const string &name);
+	void set_backend(const string &name);
+
+	// direction of the oracles created afterwards: "forward" (trees from the
+	// origins), "reverse" (from the destinations) or "auto" (the side with
+	// fewer distinct vertices)
+	static void set_default_direction(const string &name);
+	bool reversed() const { return reverse; }
+
+	void get_flows(Vector &sp);
+	// path flows and, in y, the total flow on each arc
+	void get_flows(Vector &sp, DenseArcVector &y);
+
+	// total flow on each arc only (the reduced variable of the path flows):
+	// the demands are pushed up the tree of each origin once, O(V) per
+	// origin instead of one walk per commodity
+	void get_arc_flows(DenseArcVector &y);
+
+	// delta such that adding the deltas of all calls gives the path flows
+	// of get_flows (the first call returns all of them); dynamic mode only
+	void get_flow_changes(Vector &delta);
+
+	// arcs (indices into net.arcs) of the current shortest path of commodity k
+	void get_path(int k, vector<int> &path);
 };
 
+// Support pruning: decomposes the flow of each commodity in x into paths
+// (cancelling cycles) and moves every path that carries less than
+// threshold times the commodity's demand onto the commodity's current
+// shortest path in DA, so flow conservation is preserved while the
+// support of x shrinks. Flow stranded at dead ends (rounding residue) is
+// dropped, and whatever the kept paths then fail to deliver of the
+// demand goes onto the shortest path as well.
+void prune_flows(const MultiCommoNetwork &net, ShortestPathOracle &DA, Vector &x, Real threshold);
+
 #endif
 
@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <vector>
+#include "parallel.h"
+#include "cvputility.h"
+
+namespace {
+
+__thread int this_thread = 0; // see ThreadPool::thread_index
+
+struct Pool {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;     // a new job was posted (or stop was set)
+	pthread_cond_t finished; // the last chunk of the job returned
+	std::vector<pthread_t> workers;
+	bool stop, busy;
+	unsigned job;            // number of the current job
+	int started;             // workers that have taken their index
+
+	void (*fn)(int, void*);
+	void *arg;
+	int nchunks, next, done;
+
+	Pool() : stop(false), busy(false), job(0), started(0), fn(NULL), arg(NULL), nchunks(0), next(0), done(0) {
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&wake, NULL);
+		pthread_cond_init(&finished, NULL);
+	}
+	~Pool(){
+		resize(1);
+		pthread_cond_destroy(&finished);
+		pthread_cond_destroy(&wake);
+		pthread_mutex_destroy(&lock);
+	}
+
+	// runs chunks of the current job until none is left; called with the
+	// lock held, which is released while a chunk runs
+	void work(){
+		while(next < nchunks){
+			int c = next++;
+			pthread_mutex_unlock(&lock);
+			fn(c, arg);
+			pthread_mutex_lock(&lock);
+			if(++done == nchunks) pthread_cond_signal(&finished);
+		}
+	}
+
+	static void *worker(void *p){
+		Pool &pool = *(Pool*) p;
+		pthread_mutex_lock(&pool.lock);
+		this_thread = ++pool.started;
+		for(unsigned seen = pool.job; ; seen = pool.job){
+			while(!pool.stop && pool.job == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+			if(pool.stop) break;
+			pool.work();
+		}
+		pthread_mutex_unlock(&pool.lock);
+		return NULL;
+	}
+
+	void resize(int n){
+		if(!workers.empty()){
+			pthread_mutex_lock(&lock);
+			stop = true;
+			pthread_cond_broadcast(&wake);
+			pthread_mutex_unlock(&lock);
+			FOR(t, (int) workers.size()) pthread_join(workers[t], NULL);
+			workers.clear();
+			stop = false;
+			started = 0;
+		}
+		for(int t = 1; t < n; t++){
+			pthread_t id;
+			if(pthread_create(&id, NULL, worker, this)){
+				error_handle("ThreadPool: cannot create worker thread");
+				break;
+			}
+			workers.push_back(id);
+		}
+	}
+};
+
+Pool pool;
+
+}
+
+void ThreadPool::set_threads(int n){
+	if(n < 1) n = 1;
+	if(n != threads()) pool.resize(n);
+}
+
+int ThreadPool::threads(){
+	return pool.workers.size() + 1;
+}
+
+int ThreadPool::thread_index(){
+	return this_thread;
+}
+
+void ThreadPool::run(int nchunks, void (*fn)(int, void*), void *arg){
+	pthread_mutex_lock(&pool.lock);
+	if(pool.workers.empty() || pool.busy || nchunks <= 1){
+		pthread_mutex_unlock(&pool.lock);
+		FOR(c, nchunks) fn(c, arg);
+		return;
+	}
+
+	pool.busy = true;
+	pool.fn = fn;
+	pool.arg = arg;
+	pool.nchunks = nchunks;
+	pool.next = pool.done = 0;
+	pool.job++;
+	pthread_cond_broadcast(&pool.wake);
+
+	pool.work();
+	while(pool.done < nchunks) pthread_cond_wait(&pool.finished, &pool.lock);
+	pool.busy = false;
+	pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,29 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+// Fork-join pool of POSIX threads for the data-parallel loops of the
+// solvers. A loop is cut into chunks that the workers and the calling
+// thread pick up one at a time until all are done:
+//
+//   static void body(int c, void *arg){ ... process chunk c ... }
+//   ThreadPool::run(nchunks, body, &arg);
+//
+// Chunks must write disjoint data. Sums over chunks should be kept per
+// chunk and added up by the caller in chunk order, so that they do not
+// depend on the number of threads or on which thread ran which chunk.
+class ThreadPool {
+ public:
+	// use n threads in total, the calling thread included (1 = serial)
+	static void set_threads(int n);
+	static int threads();
+
+	// index of the calling thread: 0 for the thread that issues run(),
+	// 1 .. threads()-1 for the workers; used to pick per-thread buffers
+	static int thread_index();
+
+	// calls fn(c, arg) for c = 0, ..., nchunks-1 and returns when all calls
+	// have returned; a run issued from inside a chunk is executed serially
+	static void run(int nchunks, void (*fn)(int, void*), void *arg);
+};
+
+#endif